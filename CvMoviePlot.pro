@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui network
 TARGET = CvMoviePlot
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
@@ -17,11 +17,50 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    batchrenderer.cpp \
+    csvparser.cpp \
+    framecache.cpp \
+    framecompositor.cpp \
+    frameitem.cpp \
+    framepipeline.cpp \
+    graphdata.cpp \
+    keyframeindex.cpp \
+    livesource.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    minmaxpyramid.cpp \
+    overlayblend.cpp \
+    polylinerenderer.cpp \
+    previewrenderer.cpp \
+    samplering.cpp \
+    stagetimings.cpp \
+    thumbnailstrip.cpp \
+    timelinewidget.cpp \
+    videoencoder.cpp \
+    videosource.cpp
 
 HEADERS += \
-    mainwindow.h
+    batchrenderer.h \
+    csvparser.h \
+    framecache.h \
+    framecompositor.h \
+    frameitem.h \
+    framepipeline.h \
+    graphdata.h \
+    keyframeindex.h \
+    livesource.h \
+    mainwindow.h \
+    minmaxpyramid.h \
+    overlayblend.h \
+    polylinerenderer.h \
+    previewrenderer.h \
+    samplering.h \
+    stagetimings.h \
+    thumbnailstrip.h \
+    timelinewidget.h \
+    videoencoder.h \
+    videoformat.h \
+    videosource.h
 
 FORMS += \
     mainwindow.ui
@@ -0,0 +1,364 @@
+#include "batchrenderer.h"
+#include "framepipeline.h"
+#include "keyframeindex.h"
+#include "stagetimings.h"
+
+#include <opencv2/videoio.hpp>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QFileInfo>
+#include <QProcess>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+bool BatchRenderer::isBatchInvocation(int argc, char *argv[])
+{
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--batch") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int BatchRenderer::run(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Render a graph overlay onto a video without the GUI.");
+    parser.addHelpOption();
+    QCommandLineOption batch_option("batch", "Run headless.");
+    QCommandLineOption video_option("video", "Input video file.", "file");
+    QCommandLineOption graph_option("graph", "CSV graph data (x,y per line).", "file");
+    QCommandLineOption settings_option("settings", "Overlay settings saved from the GUI.", "file");
+    QCommandLineOption output_option("output", "Output video file.", "file");
+    QCommandLineOption format_option("format", "Output format: mp4, h264, hevc, avi (MJPEG) or ffv1 (lossless).", "format");
+    QCommandLineOption bitrate_option("bitrate", "Target bitrate in kbit/s instead of a quality.", "kbps");
+    QCommandLineOption quality_option("quality", "Quality 0-100 for h264, hevc and avi.", "q");
+    QCommandLineOption preset_option("preset", "x264/x265 speed preset, ultrafast to veryslow.", "preset");
+    QCommandLineOption size_option("size", "Output size WxH; a 0 side keeps the aspect ratio.", "WxH");
+    QCommandLineOption crop_option("crop", "Region x,y,w,h of the rotated frame to export.", "x,y,w,h");
+    QCommandLineOption no_headers_option("no-headers", "The CSV has no header line.");
+    QCommandLineOption shards_option("shards", "Split the export into n segments rendered in parallel "
+                                               "(0 uses every core, joining needs ffmpeg).", "n", "1");
+    QCommandLineOption timings_option("timings", "Write the time spent per stage: a CSV summary, "
+                                                 "or a Chrome trace for a .json file.", "file");
+    parser.addOptions({batch_option, video_option, graph_option, settings_option,
+                       output_option, format_option, bitrate_option, quality_option, preset_option,
+                       size_option, crop_option,
+                       no_headers_option, shards_option, timings_option});
+    parser.process(arguments);
+
+    Job job;
+    job.video_file = parser.value(video_option);
+    job.graph_file = parser.value(graph_option);
+    job.settings_file = parser.value(settings_option);
+    job.output_file = parser.value(output_option);
+    // encoder settings saved with the overlay, overridden by the options
+    if(!job.settings_file.isEmpty()) {
+        QSettings file_settings(job.settings_file, QSettings::IniFormat);
+        job.encoder = EncoderSettings::load(file_settings);
+    }
+    if(parser.isSet(format_option)) {
+        job.encoder.format = parser.value(format_option);
+    }
+    if(parser.isSet(bitrate_option)) {
+        job.encoder.bitrate = parser.value(bitrate_option).toInt();
+    }
+    if(parser.isSet(quality_option)) {
+        job.encoder.quality = parser.value(quality_option).toInt();
+    }
+    if(parser.isSet(preset_option)) {
+        job.encoder.preset = parser.value(preset_option);
+    }
+    if(parser.isSet(size_option)) {
+        QStringList size = parser.value(size_option).split('x');
+        if(size.length() != 2) {
+            qWarning() << "--size needs WxH";
+            return 1;
+        }
+        job.output_size = cv::Size(size.at(0).toInt(), size.at(1).toInt());
+    }
+    if(parser.isSet(crop_option)) {
+        QStringList crop = parser.value(crop_option).split(',');
+        if(crop.length() != 4) {
+            qWarning() << "--crop needs x,y,w,h";
+            return 1;
+        }
+        job.crop = cv::Rect(crop.at(0).toInt(), crop.at(1).toInt(), crop.at(2).toInt(), crop.at(3).toInt());
+    }
+    job.has_headers = !parser.isSet(no_headers_option);
+    job.shards = parser.value(shards_option).toInt();
+    job.timings_file = parser.value(timings_option);
+
+    if(job.video_file.isEmpty() || job.output_file.isEmpty()) {
+        qWarning() << "batch render needs --video and --output";
+        return 1;
+    }
+
+    BatchRenderer renderer;
+    return renderer.render(job) ? 0 : 1;
+}
+
+bool BatchRenderer::render(const Job &job)
+{
+    m_frames_written = 0;
+
+    // every frame is read once: no keyframe index, no frame cache
+    VideoSource source;
+    if(!source.open(job.video_file, false)) {
+        qWarning() << "Unable to open video:" << job.video_file;
+        return false;
+    }
+
+    CompositorSettings settings;
+    if(!job.settings_file.isEmpty()) {
+        QSettings file_settings(job.settings_file, QSettings::IniFormat);
+        settings = CompositorSettings::load(file_settings);
+    }
+    else {
+        settings.fps = source.get(cv::CAP_PROP_FPS);
+    }
+    if(job.crop.area() > 0) {
+        settings.crop = job.crop;
+    }
+    if(job.output_size.width > 0 || job.output_size.height > 0) {
+        settings.output_size = job.output_size;
+    }
+
+    std::shared_ptr<const GraphData> data;
+    if(!job.graph_file.isEmpty()) {
+        data = GraphData::load(job.graph_file, job.has_headers);
+        if(!data) {
+            qWarning() << "Unable to open graph data:" << job.graph_file;
+            return false;
+        }
+    }
+
+    bool trace = job.timings_file.endsWith(".json", Qt::CaseInsensitive);
+    StageTimings &timings = StageTimings::instance();
+    timings.setTraceEnabled(trace);
+    timings.reset();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int shards = job.shards;
+    if(shards <= 0) {
+        shards = QThread::idealThreadCount();
+    }
+
+    bool ok = false;
+    if(shards > 1) {
+        source.close();
+        ok = renderSharded(job, shards, settings, data);
+    }
+    else {
+        ok = renderPipelined(job, source, settings, data);
+    }
+    if(!ok) {
+        return false;
+    }
+
+    double seconds = timer.elapsed()/1000.0;
+    qDebug() << QString("Wrote %1 frames to %2 in %3 s (%4 FPS)")
+                .arg(m_frames_written).arg(job.output_file)
+                .arg(seconds, 0, 'f', 2).arg(m_frames_written/qMax(seconds, 0.001), 0, 'f', 2);
+
+    if(!job.timings_file.isEmpty()) {
+        qDebug().noquote() << timings.report();
+        if(!(trace ? timings.writeTrace(job.timings_file) : timings.writeCsv(job.timings_file))) {
+            qWarning() << "Unable to write timings:" << job.timings_file;
+        }
+    }
+    return true;
+}
+
+bool BatchRenderer::renderPipelined(const Job &job, VideoSource &source,
+                                    const CompositorSettings &settings,
+                                    const std::shared_ptr<const GraphData> &data)
+{
+    int w = source.get(cv::CAP_PROP_FRAME_WIDTH);
+    int h = source.get(cv::CAP_PROP_FRAME_HEIGHT);
+    double fps = source.get(cv::CAP_PROP_FPS);
+
+    VideoEncoder encoder;
+    if(!encoder.open(job.output_file, job.encoder, fps, settings.outputSize(cv::Size(w, h)))) {
+        qWarning() << "Unable to record video to:" << job.output_file;
+        return false;
+    }
+
+    // decode, composite and encode overlap, so throughput follows the
+    // slowest stage rather than their sum
+    FramePipeline pipeline;
+    pipeline.setSettings(settings);
+    pipeline.setGraphData(data);
+    pipeline.setWriter(&encoder);
+    pipeline.start(&source, 0);
+    pipeline.wait();
+    pipeline.setWriter(nullptr);
+    encoder.close();
+    m_frames_written = encoder.stats().encoded;
+    return true;
+}
+
+// keyframe is the last keyframe at or before first_frame, -1 if unknown
+bool BatchRenderer::renderShard(const Job &job, const QString &segment_file, int keyframe,
+                                int first_frame, int frame_count, const CompositorSettings &settings,
+                                const std::shared_ptr<const GraphData> &data, int *frames_written)
+{
+    *frames_written = 0;
+
+    cv::VideoCapture capture;
+    if(!capture.open(job.video_file.toStdString())) {
+        return false;
+    }
+    // a seek to a keyframe lands on it; from there decode forward, which
+    // is exact however long the GOP. Without keyframes, decode from the
+    // start.
+    int position = 0;
+    if(keyframe > 0) {
+        capture.set(cv::CAP_PROP_POS_FRAMES, keyframe);
+        position = keyframe;
+    }
+    for(; position < first_frame; ++position) {
+        if(!capture.grab()) {
+            return false;
+        }
+    }
+
+    int w = capture.get(cv::CAP_PROP_FRAME_WIDTH);
+    int h = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+    double fps = capture.get(cv::CAP_PROP_FPS);
+
+    cv::VideoWriter writer;
+    if(!VideoEncoder::openWriter(writer, segment_file, job.encoder, fps, settings.outputSize(cv::Size(w, h)))) {
+        return false;
+    }
+
+    FrameCompositor compositor;
+    compositor.setSettings(settings);
+    compositor.setGraphData(data);
+
+    // decoded at the source size, composited at the output size
+    cv::Mat decoded;
+    cv::Mat frame;
+    for(int i = 0; i < frame_count; ++i) {
+        {
+            StageTimings::Scope timing(StageTimings::Decode, first_frame + i);
+            if(!capture.read(decoded)) {
+                break;
+            }
+        }
+        compositor.transform(decoded, frame);
+        compositor.blend(frame, first_frame + i, capture.get(cv::CAP_PROP_POS_MSEC));
+        StageTimings::Scope timing(StageTimings::Encode, first_frame + i);
+        writer.write(frame);
+        ++(*frames_written);
+    }
+    writer.release();
+    // a shard that ends early is caught by the caller
+    return true;
+}
+
+bool BatchRenderer::renderSharded(const Job &job, int shards,
+                                  const CompositorSettings &settings,
+                                  const std::shared_ptr<const GraphData> &data)
+{
+    QString ffmpeg = QStandardPaths::findExecutable("ffmpeg");
+    if(ffmpeg.isEmpty()) {
+        qWarning() << "ffmpeg not found; segments cannot be joined, rendering sequentially";
+        VideoSource source;
+        if(!source.open(job.video_file, false)) {
+            return false;
+        }
+        return renderPipelined(job, source, settings, data);
+    }
+
+    // CAP_PROP_FRAME_COUNT is only an estimate for many containers; the
+    // index has the exact count and the keyframes the shards start from
+    KeyframeIndex index;
+    index.open(job.video_file);
+    index.wait();
+    int total_frames = index.frameCount();
+    if(total_frames <= 0) {
+        qWarning() << "Unknown frame count, cannot shard:" << job.video_file;
+        return false;
+    }
+    shards = std::min(shards, total_frames);
+
+    QTemporaryDir segment_dir;
+    if(!segment_dir.isValid()) {
+        qWarning() << "Unable to create a directory for segments";
+        return false;
+    }
+    QString suffix = QFileInfo(job.output_file).suffix();
+
+    // every shard runs on one core; keep OpenCV from spawning its own threads per shard
+    int cv_threads = cv::getNumThreads();
+    cv::setNumThreads(1);
+
+    std::vector<std::thread> threads;
+    std::vector<int> frames_written(shards, 0);
+    std::vector<char> shard_ok(shards, 0);
+    std::vector<int> shard_frames;
+    QStringList segments;
+    int chunk = (total_frames + shards - 1)/shards;
+    for(int i = 0; i < shards; ++i) {
+        int first_frame = i*chunk;
+        int frame_count = std::min(chunk, total_frames - first_frame);
+        if(frame_count <= 0) {
+            break;
+        }
+        QString segment_file = segment_dir.filePath(QString("segment%1.%2").arg(i, 4, 10, QChar('0')).arg(suffix));
+        segments << segment_file;
+        shard_frames.push_back(frame_count);
+        int keyframe = index.keyframeBefore(first_frame);
+        threads.push_back(std::thread([=, &job, &settings, &data, &frames_written, &shard_ok]{
+            shard_ok[i] = renderShard(job, segment_file, keyframe, first_frame, frame_count,
+                                      settings, data, &frames_written[i]);
+        }));
+    }
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+    cv::setNumThreads(cv_threads);
+
+    for(int i = 0; i < segments.length(); ++i) {
+        // only the last shard may come up short: the stream ended early
+        bool last = i + 1 == segments.length();
+        if(!shard_ok[i] || frames_written[i] == 0 || (!last && frames_written[i] != shard_frames[i])) {
+            qWarning() << "Shard" << i << "failed after" << frames_written[i] << "of" << shard_frames[i] << "frames";
+            return false;
+        }
+        if(frames_written[i] != shard_frames[i]) {
+            qWarning() << "The video ended after" << i*chunk + frames_written[i] << "of" << total_frames << "frames";
+        }
+        m_frames_written += frames_written[i];
+    }
+
+    // join without re-encoding: every segment starts on a keyframe
+    QFile list(segment_dir.filePath("segments.txt"));
+    if(!list.open(QFile::WriteOnly)) {
+        return false;
+    }
+    for(QString segment : segments) {
+        // quoted for the concat demuxer, which ends a quote at every '
+        list.write(QString("file '%1'\n").arg(segment.replace("'", "'\\''")).toUtf8());
+    }
+    list.close();
+
+    QProcess process;
+    process.start(ffmpeg, {"-y", "-loglevel", "error", "-f", "concat", "-safe", "0",
+                           "-i", list.fileName(), "-c", "copy", job.output_file});
+    if(!process.waitForFinished(-1) || process.exitCode() != 0) {
+        qWarning() << "Joining segments failed:" << process.readAllStandardError();
+        return false;
+    }
+    return true;
+}
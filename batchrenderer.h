@@ -0,0 +1,57 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QString>
+#include <QStringList>
+
+#include <opencv2/videoio.hpp>
+
+#include "framecompositor.h"
+#include "videoencoder.h"
+#include "videosource.h"
+
+// renders a video with its graph overlay without a GUI, as fast as
+// decode and encode allow
+class BatchRenderer
+{
+public:
+    struct Job
+    {
+        QString video_file;
+        QString graph_file;
+        QString settings_file;
+        QString output_file;
+        EncoderSettings encoder;
+        // override the settings file unless empty
+        cv::Rect crop;
+        cv::Size output_size;
+        bool has_headers = true;
+        int shards = 1;  // parallel segments; 0 for one per core
+        QString timings_file;   // stage timings as .csv or Chrome trace .json
+    };
+
+    // true if the command line asks for a headless render
+    static bool isBatchInvocation(int argc, char *argv[]);
+
+    // parse the command line and run the job; returns a process exit code
+    static int run(const QStringList &arguments);
+
+    bool render(const Job &job);
+
+    int framesWritten() const { return m_frames_written; }
+
+private:
+    bool renderPipelined(const Job &job, VideoSource &source,
+                         const CompositorSettings &settings,
+                         const std::shared_ptr<const GraphData> &data);
+    bool renderSharded(const Job &job, int shards,
+                       const CompositorSettings &settings,
+                       const std::shared_ptr<const GraphData> &data);
+    static bool renderShard(const Job &job, const QString &segment_file, int keyframe,
+                            int first_frame, int frame_count, const CompositorSettings &settings,
+                            const std::shared_ptr<const GraphData> &data, int *frames_written);
+
+    int m_frames_written = 0;
+};
+
+#endif // BATCHRENDERER_H
@@ -0,0 +1,52 @@
+QT       += core gui network
+TARGET = CvMoviePlotBenchmark
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    pipelinebenchmark.cpp \
+    ../csvparser.cpp \
+    ../framecache.cpp \
+    ../framecompositor.cpp \
+    ../graphdata.cpp \
+    ../keyframeindex.cpp \
+    ../livesource.cpp \
+    ../minmaxpyramid.cpp \
+    ../overlayblend.cpp \
+    ../polylinerenderer.cpp \
+    ../samplering.cpp \
+    ../stagetimings.cpp \
+    ../videosource.cpp
+
+HEADERS += \
+    pipelinebenchmark.h \
+    ../csvparser.h \
+    ../framecache.h \
+    ../framecompositor.h \
+    ../graphdata.h \
+    ../keyframeindex.h \
+    ../livesource.h \
+    ../minmaxpyramid.h \
+    ../overlayblend.h \
+    ../polylinerenderer.h \
+    ../samplering.h \
+    ../stagetimings.h \
+    ../videoformat.h \
+    ../videosource.h
+
+OPENCV_PATH = $$files(/usr/local/Cellar/opencv/*)
+
+LIBS += -L/$$OPENCV_PATH/lib/ \
+        -lopencv_core \
+        -lopencv_imgproc \
+        -lopencv_videoio
+
+INCLUDEPATH += $$OPENCV_PATH/include/opencv4
+
+INCLUDEPATH += /Users/erik/Developer/CvPlot/CvPlot/inc
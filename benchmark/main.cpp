@@ -0,0 +1,509 @@
+#include "csvparser.h"
+#include "framecompositor.h"
+#include "overlayblend.h"
+#include "pipelinebenchmark.h"
+#include "polylinerenderer.h"
+#include "videoformat.h"
+#include "videosource.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QStringList>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#define CVPLOT_HEADER_ONLY
+#include <CvPlot/cvplot.h>
+
+// the CSV path CvMoviePlot used before CsvParser: split into lines, split
+// every line, QString::toDouble per field
+static qint64 legacyParse(const QString &file_name)
+{
+    QFile file(file_name);
+    if(!file.open(QFile::ReadOnly)) {
+        return 0;
+    }
+    QString data(file.readAll());
+    QStringList lines = data.split("\n");
+
+    QVector<double> keys;
+    QVector<double> values;
+    keys.reserve(lines.length() - 1);
+    values.reserve(lines.length() - 1);
+    foreach(QString value, lines.mid(1)) {
+        QStringList data_split = value.split(",");
+        if(data_split.length() >= 2) {
+            keys << data_split.at(0).toDouble();
+            values << data_split.at(1).toDouble();
+        }
+    }
+    return keys.length();
+}
+
+static bool writeCsv(const QString &file_name, qint64 rows)
+{
+    QFile file(file_name);
+    if(!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    QByteArray block;
+    block.reserve(1 << 20);
+    block.append("time,pressure\n");
+    for(qint64 i = 0; i < rows; ++i) {
+        double t = i/1000.0;
+        block.append(QByteArray::number(t, 'f', 3));
+        block.append(',');
+        block.append(QByteArray::number(100.0 + 20.0*std::sin(t), 'f', 6));
+        block.append('\n');
+        if(block.size() > (1 << 20) - 64) {
+            file.write(block);
+            block.clear();
+        }
+    }
+    file.write(block);
+    return true;
+}
+
+// ms per call of f, best of a few rounds
+template<typename F>
+static double timeMs(F f, int repeats)
+{
+    double best = 0.0;
+    for(int round = 0; round < 3; ++round) {
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 0; i < repeats; ++i) {
+            f();
+        }
+        double ms = timer.nsecsElapsed()/1e6/repeats;
+        best = round == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+// the old constant-alpha addWeighted against the premultiplied kernels
+static void benchmarkBlend(int repeats)
+{
+    printf("%12s %14s %12s %12s %12s\n", "roi", "addWeighted ms", "scalar ms", "simd ms", "simd");
+    const cv::Size sizes[] = { cv::Size(1920, 540), cv::Size(1920, 1080), cv::Size(3840, 1080), cv::Size(3840, 2160) };
+    for(const cv::Size &size : sizes) {
+        // a plot-like overlay: white with some colored lines
+        cv::Mat plot(size, CV_8UC3, cv::Scalar(255, 255, 255));
+        for(int x = 0; x < size.width; x += 40) {
+            cv::line(plot, cv::Point(x, 0), cv::Point(size.width - x, size.height - 1), cv::Scalar(255, 0, 0), 2);
+        }
+        cv::Mat frame(size, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::Mat color;
+        cv::Mat inverse_alpha;
+
+        double add_weighted_ms = timeMs([&]{
+            cv::addWeighted(plot, 0.85, frame, 0.15, 0.0, frame);
+        }, repeats);
+        double scalar_ms = timeMs([&]{
+            OverlayBlend::premultiply(plot, 0.85, color, inverse_alpha);
+            OverlayBlend::blendScalar(color, inverse_alpha, frame);
+        }, repeats);
+        double simd_ms = timeMs([&]{
+            OverlayBlend::premultiply(plot, 0.85, color, inverse_alpha);
+            OverlayBlend::blend(color, inverse_alpha, frame);
+        }, repeats);
+
+        QByteArray roi = QString("%1x%2").arg(size.width).arg(size.height).toLatin1();
+        printf("%12s %14.2f %12.2f %12.2f %12s\n", roi.constData(),
+               add_weighted_ms, scalar_ms, simd_ms, OverlayBlend::kernelName());
+    }
+}
+
+// the points cv::polylines draws for keys against values in plot_rect,
+// relative to it and with plot_shift fractional bits, mapped like
+// PolylineRenderer maps them
+static const int plot_shift = 4;
+
+static std::vector<cv::Point> plotPoints(const std::vector<double> &keys, const std::vector<double> &values,
+                                         const cv::Rect &plot_rect, double x_min, double x_max, double y_min, double y_max)
+{
+    const double x_scale = (plot_rect.width - 1)/(x_max - x_min)*(1 << plot_shift);
+    const double y_scale = (plot_rect.height - 1)/(y_max - y_min)*(1 << plot_shift);
+    std::vector<cv::Point> points(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        points[i] = cv::Point(cvRound((keys[i] - x_min)*x_scale), cvRound((y_max - values[i])*y_scale));
+    }
+    return points;
+}
+
+// series_count series of points points over plot_width columns, like the
+// benchmark CSV: a slow sine per series with some noise
+static void plotSeries(int series_count, int points, int plot_width,
+                       std::vector<std::vector<double>> &keys, std::vector<std::vector<double>> &values)
+{
+    keys.assign(series_count, std::vector<double>());
+    values.assign(series_count, std::vector<double>());
+    cv::RNG rng(1);
+    for(int s = 0; s < series_count; ++s) {
+        for(int i = 0; i < points; ++i) {
+            double key = i*(plot_width/50.0)/points;
+            keys[s].push_back(key);
+            values[s].push_back(100.0*(s + 1) + 20.0*std::sin(key/(0.5*(s + 1))) + rng.uniform(-2.0, 2.0));
+        }
+    }
+}
+
+// the series drawn by a CvPlot render of axes and series, as the graph
+// was drawn before PolylineRenderer, by cv::polylines over the cached axes
+// layer, and natively over it
+static void benchmarkPlot(int repeats, int series_count)
+{
+    printf("%12s %8s %12s %12s %12s %10s\n", "roi", "points", "cvplot ms", "polylines ms", "native ms", "speedup");
+    const cv::Size sizes[] = { cv::Size(1920, 540), cv::Size(1920, 1080), cv::Size(3840, 1080), cv::Size(3840, 2160) };
+    for(const cv::Size &size : sizes) {
+        // the GUI's default margins; two points per plot column, like a
+        // decimated window
+        cv::Rect plot_rect(120, 40, size.width - 120 - 30, size.height - 40 - 80);
+        int points = 2*plot_rect.width;
+        std::vector<std::vector<double>> keys;
+        std::vector<std::vector<double>> values;
+        plotSeries(series_count, points, plot_rect.width, keys, values);
+        const double x_min = 0.0;
+        const double x_max = keys[0].back();
+        const double y_min = 70.0;
+        const double y_max = 100.0*series_count + 30.0;
+
+        CvPlot::Axes axes = CvPlot::makePlotAxes();
+        axes.setMargins(120, 30, 40, 80);
+        axes.enableHorizontalGrid();
+        axes.setXLim(std::pair<double,double>(x_min, x_max));
+        axes.setYLim(std::pair<double,double>(y_min, y_max));
+        for(int s = 0; s < series_count; ++s) {
+            axes.create<CvPlot::Series>(keys[s], values[s], "-")
+                    .setColor(SeriesStyle::defaultColor(s))
+                    .setLineWidth(2);
+        }
+        cv::Mat3b graph(size.height, size.width);
+        double cvplot_ms = timeMs([&]{
+            axes.render(graph);
+        }, repeats);
+
+        CvPlot::Axes static_axes = CvPlot::makePlotAxes();
+        static_axes.setMargins(120, 30, 40, 80);
+        static_axes.enableHorizontalGrid();
+        static_axes.setXLim(std::pair<double,double>(x_min, x_max));
+        static_axes.setYLim(std::pair<double,double>(y_min, y_max));
+        cv::Mat3b axes_layer = static_axes.render(size.height, size.width);
+        double polylines_ms = timeMs([&]{
+            axes_layer.copyTo(graph);
+            cv::Mat plot = graph(plot_rect);
+            for(int s = 0; s < series_count; ++s) {
+                std::vector<cv::Point> line = plotPoints(keys[s], values[s], plot_rect, x_min, x_max, y_min, y_max);
+                cv::polylines(plot, line, false, SeriesStyle::defaultColor(s), 2, cv::LINE_AA, plot_shift);
+            }
+        }, repeats);
+
+        PolylineRenderer renderer;
+        renderer.setViewport(plot_rect, x_min, x_max, y_min, y_max);
+        double native_ms = timeMs([&]{
+            axes_layer.copyTo(graph);
+            for(int s = 0; s < series_count; ++s) {
+                renderer.draw(graph, keys[s].data(), values[s].data(), points, SeriesStyle::defaultColor(s), 2);
+            }
+        }, repeats);
+
+        QByteArray roi = QString("%1x%2").arg(size.width).arg(size.height).toLatin1();
+        printf("%12s %8d %12.2f %12.2f %12.2f %9.1fx\n", roi.constData(), points*series_count,
+               cvplot_ms, polylines_ms, native_ms, native_ms > 0.0 ? cvplot_ms/native_ms : 0.0);
+    }
+}
+
+// PolylineRenderer against cv::polylines with LINE_AA on the same mapping
+// and background, per thickness, for smooth series with a point every 8
+// columns and for decimated ones with two per column. Both must put down
+// the same ink within 10%. Smooth lines must also agree pixel by pixel;
+// decimated ones are mostly joints, which cv::polylines draws with smaller
+// caps and blends once per segment, so only their weight is compared.
+// Returns a process exit code.
+static int checkPlot()
+{
+    const cv::Size size(1920, 1080);
+    const cv::Rect plot_rect(120, 40, size.width - 120 - 30, size.height - 40 - 80);
+    const int series_count = 3;
+    printf("%10s %8s %8s %10s %10s %8s\n", "thickness", "points", "ink", "mean diff", "diff > 64", "result");
+    bool passed = true;
+    for(int thickness = 1; thickness <= 4; ++thickness) {
+        for(int dense = 0; dense < 2; ++dense) {
+            int points = dense ? 2*plot_rect.width : plot_rect.width/8;
+            std::vector<std::vector<double>> keys;
+            std::vector<std::vector<double>> values;
+            plotSeries(series_count, points, plot_rect.width, keys, values);
+            const double x_min = 0.0;
+            const double x_max = keys[0].back();
+            const double y_min = 70.0;
+            const double y_max = 100.0*series_count + 30.0;
+
+            cv::Mat native(size, CV_8UC3, cv::Scalar::all(255));
+            cv::Mat reference(size, CV_8UC3, cv::Scalar::all(255));
+            PolylineRenderer renderer;
+            renderer.setViewport(plot_rect, x_min, x_max, y_min, y_max);
+            cv::Mat plot = reference(plot_rect);
+            for(int s = 0; s < series_count; ++s) {
+                renderer.draw(native, keys[s].data(), values[s].data(), points, SeriesStyle::defaultColor(s), thickness);
+                std::vector<cv::Point> line = plotPoints(keys[s], values[s], plot_rect, x_min, x_max, y_min, y_max);
+                cv::polylines(plot, line, false, SeriesStyle::defaultColor(s), thickness, cv::LINE_AA, plot_shift);
+            }
+
+            // over the pixels either of them drew on
+            double native_ink = 0.0;
+            double reference_ink = 0.0;
+            double diff_sum = 0.0;
+            long long far_off = 0;
+            long long drawn = 0;
+            for(int y = 0; y < size.height; ++y) {
+                const uchar *a = native.ptr<uchar>(y);
+                const uchar *b = reference.ptr<uchar>(y);
+                for(int x = 0; x < 3*size.width; x += 3) {
+                    int diff = 0;
+                    bool on_line = false;
+                    for(int c = 0; c < 3; ++c) {
+                        native_ink += 255 - a[x + c];
+                        reference_ink += 255 - b[x + c];
+                        diff = std::max(diff, std::abs(a[x + c] - b[x + c]));
+                        on_line = on_line || a[x + c] != 255 || b[x + c] != 255;
+                    }
+                    if(on_line) {
+                        ++drawn;
+                        diff_sum += diff;
+                        far_off += diff > 64;
+                    }
+                }
+            }
+            double ink = reference_ink > 0.0 ? native_ink/reference_ink : 0.0;
+            double mean_diff = drawn > 0 ? diff_sum/drawn : 0.0;
+            double far_off_share = drawn > 0 ? 100.0*far_off/drawn : 0.0;
+            bool ok = ink > 0.9 && ink < 1.1 && (dense || (mean_diff < 16.0 && far_off_share < 2.0));
+            printf("%10d %8d %8.3f %10.2f %9.2f%% %8s\n", thickness, points*series_count,
+                   ink, mean_diff, far_off_share, ok ? "ok" : "FAILED");
+            passed = passed && ok;
+        }
+    }
+    return passed ? 0 : 1;
+}
+
+// frame i shows i in binary as a row of black and white cells, which
+// survive lossy compression
+static const int frame_number_bits = 12;
+
+static void stampFrameNumber(cv::Mat &frame, int index)
+{
+    int cell = frame.cols/frame_number_bits;
+    for(int bit = 0; bit < frame_number_bits; ++bit) {
+        cv::Scalar color = (index >> bit) & 1 ? cv::Scalar::all(255) : cv::Scalar::all(0);
+        cv::rectangle(frame, cv::Rect(bit*cell, 0, cell, frame.rows/4), color, cv::FILLED);
+    }
+}
+
+static int readFrameNumber(const cv::Mat &frame)
+{
+    int cell = frame.cols/frame_number_bits;
+    int index = 0;
+    for(int bit = 0; bit < frame_number_bits; ++bit) {
+        // the middle of the cell, away from block edges
+        cv::Rect middle(bit*cell + cell/4, frame.rows/16, cell/2, frame.rows/8);
+        if(cv::mean(frame(middle))[0] > 128.0) {
+            index |= 1 << bit;
+        }
+    }
+    return index;
+}
+
+// VideoSource::read(i) must return frame i whatever was read before:
+// forward, backward, at random and right after seek(). Intra-only MJPG
+// is read with and without the keyframe index, long-GOP MPEG-4 only with
+// it, since the backend's own seeking is not exact there. Returns a
+// process exit code.
+static int checkSeek(int frames)
+{
+    QTemporaryDir dir;
+    if(!dir.isValid()) {
+        qWarning() << "unable to create a temporary directory";
+        return 1;
+    }
+    frames = std::min(frames, 1 << frame_number_bits);
+    std::vector<int> order;
+    for(int i = 0; i < frames; ++i) {
+        order.push_back(i);
+    }
+    for(int i = frames - 1; i >= 0; --i) {
+        order.push_back(i);
+    }
+    cv::RNG rng(1);
+    for(int i = 0; i < frames; ++i) {
+        order.push_back(rng.uniform(0, frames));
+    }
+
+    printf("%8s %8s %8s %8s %8s\n", "format", "index", "cache", "reads", "wrong");
+    long long wrong_total = 0;
+    const char *formats[] = { "avi", "mp4" };
+    for(const char *format : formats) {
+        QString file_name = dir.filePath(QString("numbers.%1").arg(format));
+        cv::VideoWriter writer;
+        if(!writer.open(file_name.toStdString(), fourccForFormat(format), 25.0, cv::Size(384, 216))) {
+            printf("%8s no writer, skipped\n", format);
+            continue;
+        }
+        cv::Mat frame(216, 384, CV_8UC3);
+        for(int i = 0; i < frames; ++i) {
+            frame.setTo(cv::Scalar::all(128));
+            stampFrameNumber(frame, i);
+            writer.write(frame);
+        }
+        writer.release();
+
+        for(int pass = 0; pass < 3; ++pass) {
+            bool index = pass > 0;
+            bool cache = pass == 2;
+            if(!index && QString(format) != "avi") {
+                continue;
+            }
+            VideoSource source;
+            if(!source.open(file_name, index)) {
+                qWarning() << "unable to open" << file_name;
+                return 1;
+            }
+            if(!cache) {
+                source.cache().setBudget(0);
+            }
+            while(index && !source.index().isReady()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            int reads = 0;
+            int wrong = 0;
+            cv::Mat decoded;
+            for(int target : order) {
+                ++reads;
+                if(!source.read(target, decoded) || readFrameNumber(decoded) != target) {
+                    ++wrong;
+                }
+            }
+            for(int i = 0; i < 16; ++i) {
+                int target = rng.uniform(0, frames);
+                ++reads;
+                if(!source.seek(target) || !source.read(target, decoded) || readFrameNumber(decoded) != target) {
+                    ++wrong;
+                }
+            }
+            printf("%8s %8s %8s %8d %8d\n", format, index ? "yes" : "no", cache ? "yes" : "no", reads, wrong);
+            wrong_total += wrong;
+        }
+    }
+    return wrong_total == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compare the CSV loading, overlay blending and plotting paths of CvMoviePlot.");
+    parser.addHelpOption();
+    QCommandLineOption rows_option("rows", "Comma separated row counts to generate.", "list", "1000000,10000000");
+    QCommandLineOption skip_legacy_option("skip-legacy", "Only time CsvParser (the legacy path needs lots of memory).");
+    QCommandLineOption blend_option("blend", "Time the overlay blend at 1080p and 4K ROI sizes instead.");
+    QCommandLineOption plot_option("plot", "Time drawing the graph with CvPlot, cv::polylines and PolylineRenderer instead.");
+    QCommandLineOption repeats_option("repeats", "Calls per timed round for --blend and --plot.", "n", "20");
+    QCommandLineOption check_seek_option("check-seek", "Check that reading frame i returns frame i after any read or seek instead.");
+    QCommandLineOption check_plot_option("check-plot", "Check PolylineRenderer's lines against cv::polylines instead.");
+    parser.addOptions({rows_option, skip_legacy_option, blend_option, plot_option, repeats_option, check_seek_option,
+                       check_plot_option});
+
+    // --pipeline: every stage of compositing a generated video
+    PipelineBenchmark::Config defaults;
+    QCommandLineOption pipeline_option("pipeline", "Time each stage of compositing a generated video and CSV instead.");
+    QCommandLineOption width_option("width", "Generated video width for --pipeline.", "px", QString::number(defaults.width));
+    QCommandLineOption height_option("height", "Generated video height for --pipeline.", "px", QString::number(defaults.height));
+    QCommandLineOption frames_option("frames", "Generated video length for --pipeline and --check-seek.", "n", QString::number(defaults.frames));
+    QCommandLineOption fps_option("fps", "Generated video frame rate for --pipeline.", "fps", QString::number(defaults.fps));
+    QCommandLineOption sample_rate_option("sample-rate", "CSV rows per second of video for --pipeline.", "rows", QString::number(defaults.sample_rate));
+    QCommandLineOption series_option("series", "Series columns drawn for --pipeline and --plot.", "n", QString::number(defaults.series));
+    QCommandLineOption rotation_option("rotation", "Rotation in degrees for --pipeline.", "deg", "0");
+    QCommandLineOption fixed_limits_option("fixed-limits", "Fixed axis limits (cached axes) for --pipeline.");
+    QCommandLineOption smooth_y_option("smooth-y", "Fixed x limits and smoothed autoscaled y limits for --pipeline.");
+    QCommandLineOption format_option("format", "Encoded format for --pipeline: avi, mp4 or h264.", "format", defaults.format);
+    QCommandLineOption output_option("output", "Write --pipeline results to a .json or .csv file instead of stdout.", "file");
+    parser.addOptions({pipeline_option, width_option, height_option, frames_option, fps_option, sample_rate_option,
+                       series_option, rotation_option, fixed_limits_option, smooth_y_option,
+                       format_option, output_option});
+    parser.process(a);
+
+    if(parser.isSet(blend_option)) {
+        benchmarkBlend(std::max(1, parser.value(repeats_option).toInt()));
+        return 0;
+    }
+    if(parser.isSet(plot_option)) {
+        benchmarkPlot(std::max(1, parser.value(repeats_option).toInt()),
+                      parser.isSet(series_option) ? std::max(1, parser.value(series_option).toInt()) : 3);
+        return 0;
+    }
+    if(parser.isSet(check_plot_option)) {
+        return checkPlot();
+    }
+    if(parser.isSet(check_seek_option)) {
+        return checkSeek(parser.isSet(frames_option) ? std::max(1, parser.value(frames_option).toInt()) : 120);
+    }
+    if(parser.isSet(pipeline_option)) {
+        PipelineBenchmark::Config config;
+        config.width = std::max(16, parser.value(width_option).toInt());
+        config.height = std::max(16, parser.value(height_option).toInt());
+        config.frames = std::max(1, parser.value(frames_option).toInt());
+        config.fps = std::max(1.0, parser.value(fps_option).toDouble());
+        config.sample_rate = std::max(1.0, parser.value(sample_rate_option).toDouble());
+        config.series = std::max(1, parser.value(series_option).toInt());
+        config.rotation = parser.value(rotation_option).toDouble();
+        config.fixed_limits = parser.isSet(fixed_limits_option);
+        config.smooth_scale_y = parser.isSet(smooth_y_option);
+        config.format = parser.value(format_option);
+        return PipelineBenchmark(config).run(parser.value(output_option));
+    }
+
+    QTemporaryDir dir;
+    if(!dir.isValid()) {
+        qWarning() << "unable to create a temporary directory";
+        return 1;
+    }
+
+    printf("%12s %12s %12s %12s %10s\n", "rows", "legacy ms", "parser ms", "speedup", "malformed");
+    foreach(QString rows_text, parser.value(rows_option).split(",")) {
+        qint64 rows = rows_text.toLongLong();
+        QString file_name = dir.filePath(QString("rows%1.csv").arg(rows));
+        if(!writeCsv(file_name, rows)) {
+            qWarning() << "unable to write" << file_name;
+            return 1;
+        }
+
+        QElapsedTimer timer;
+        double legacy_ms = 0.0;
+        if(!parser.isSet(skip_legacy_option)) {
+            timer.start();
+            legacyParse(file_name);
+            legacy_ms = timer.nsecsElapsed()/1e6;
+        }
+
+        timer.start();
+        CsvParser::Result result = CsvParser().parseFile(file_name);
+        double parser_ms = timer.nsecsElapsed()/1e6;
+
+        printf("%12lld %12.1f %12.1f %11.1fx %10lld\n", rows, legacy_ms, parser_ms,
+               legacy_ms > 0.0 ? legacy_ms/parser_ms : 0.0, result.malformed_rows);
+        QFile::remove(file_name);
+    }
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "pipelinebenchmark.h"
+#include "framecompositor.h"
+#include "graphdata.h"
+#include "stagetimings.h"
+#include "videoformat.h"
+#include "videosource.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QDebug>
+#include <cmath>
+#include <cstdio>
+
+PipelineBenchmark::PipelineBenchmark(const Config &config)
+    : m_config(config)
+{
+}
+
+// a textured background with a moving bright block, so the encoder has
+// some motion to work on; not timed
+bool PipelineBenchmark::writeVideo(const QString &file_name) const
+{
+    const Config &c = m_config;
+    cv::VideoWriter writer;
+    if(!writer.open(file_name.toStdString(), cv::VideoWriter::fourcc('M','J','P','G'),
+                    c.fps, cv::Size(c.width, c.height))) {
+        return false;
+    }
+    cv::Mat texture(c.height, c.width, CV_8UC3);
+    cv::randu(texture, cv::Scalar::all(0), cv::Scalar::all(160));
+    cv::Mat frame;
+    int block = std::max(c.height/8, 1);
+    for(int i = 0; i < c.frames; ++i) {
+        texture.copyTo(frame);
+        int x = (i*8) % std::max(c.width - block, 1);
+        cv::rectangle(frame, cv::Rect(x, c.height/4, block, block), cv::Scalar(240, 240, 240), cv::FILLED);
+        writer.write(frame);
+    }
+    return true;
+}
+
+// time in seconds and one sine per series
+bool PipelineBenchmark::writeCsv(const QString &file_name) const
+{
+    const Config &c = m_config;
+    QFile file(file_name);
+    if(!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    QByteArray block;
+    block.append("time");
+    for(int s = 0; s < c.series; ++s) {
+        block.append(QString(",series%1").arg(s + 1).toLatin1());
+    }
+    block.append('\n');
+    qint64 rows = static_cast<qint64>(std::ceil(c.frames/c.fps*c.sample_rate));
+    for(qint64 i = 0; i < rows; ++i) {
+        double t = i/c.sample_rate;
+        block.append(QByteArray::number(t, 'f', 6));
+        for(int s = 0; s < c.series; ++s) {
+            block.append(',');
+            block.append(QByteArray::number(100.0*(s + 1) + 20.0*std::sin(t*(s + 1)), 'f', 6));
+        }
+        block.append('\n');
+        if(block.size() > (1 << 20) - 256) {
+            file.write(block);
+            block.clear();
+        }
+    }
+    file.write(block);
+    return true;
+}
+
+int PipelineBenchmark::run(const QString &output_file)
+{
+    const Config &c = m_config;
+    QTemporaryDir dir;
+    if(!dir.isValid()) {
+        qWarning() << "unable to create a temporary directory";
+        return 1;
+    }
+    QString video_file = dir.filePath("input.avi");
+    QString csv_file = dir.filePath("input.csv");
+    QString output_video = dir.filePath(QString("output.%1").arg(c.format == "avi" ? "avi" : "mp4"));
+    qDebug() << "generating" << c.frames << "frames of" << c.width << "x" << c.height << "and their CSV";
+    if(!writeVideo(video_file) || !writeCsv(csv_file)) {
+        qWarning() << "unable to generate the input files";
+        return 1;
+    }
+
+    // a first load parses and writes the column cache, a second maps it
+    QElapsedTimer timer;
+    timer.start();
+    std::shared_ptr<GraphData> data = GraphData::load(csv_file, true);
+    double csv_load_ms = timer.nsecsElapsed()/1e6;
+    timer.start();
+    data = GraphData::load(csv_file, true);
+    double csv_reload_ms = timer.nsecsElapsed()/1e6;
+    if(!data) {
+        qWarning() << "unable to load" << csv_file;
+        return 1;
+    }
+
+    VideoSource source;
+    if(!source.open(video_file, false)) {
+        qWarning() << "unable to open" << video_file;
+        return 1;
+    }
+    // every frame is decoded, none served from memory
+    source.cache().setBudget(0);
+
+    cv::VideoWriter writer;
+    if(!writer.open(output_video.toStdString(), fourccForFormat(c.format), c.fps, cv::Size(c.width, c.height))) {
+        qWarning() << "unable to open a" << c.format << "writer";
+        return 1;
+    }
+
+    // the GUI's defaults: graph over the lower half, 10 s of data
+    CompositorSettings settings;
+    settings.rotation = c.rotation;
+    settings.fps = c.fps;
+    settings.graph_rect = cv::Rect(0, c.height/2, c.width, c.height/2);
+    settings.series.clear();
+    for(int s = 0; s < c.series; ++s) {
+        SeriesStyle style;
+        style.column = s + 1;
+        style.color = SeriesStyle::defaultColor(s);
+        settings.series.push_back(style);
+    }
+    settings.x_rate = static_cast<int>(std::lround(c.sample_rate));
+    settings.x_window = std::max(2, static_cast<int>(c.sample_rate*10));
+    if(c.fixed_limits) {
+        settings.auto_scale_x = false;
+        settings.auto_scale_y = false;
+        settings.x_min = 0.0;
+        settings.x_max = c.frames/c.fps + 10.0;
+        settings.y_min = 0.0;
+        settings.y_max = 100.0*c.series + 40.0;
+    }
+    else if(c.smooth_scale_y) {
+        settings.auto_scale_x = false;
+        settings.x_min = 0.0;
+        settings.x_max = c.frames/c.fps + 10.0;
+        settings.smooth_scale_y = true;
+    }
+    FrameCompositor compositor;
+    compositor.setSettings(settings);
+    compositor.setGraphData(data);
+
+    StageTimings &timings = StageTimings::instance();
+    timings.reset();
+    cv::Mat frame;
+    cv::Mat display;
+    int frames = 0;
+    timer.start();
+    for(int i = 0; i < c.frames; ++i) {
+        double time_ms = 0.0;
+        if(!source.read(i, frame, &time_ms)) {
+            break;
+        }
+        compositor.compose(frame, i, time_ms);
+        {
+            // what the view gets: BGRX and a QImage header over it
+            StageTimings::Scope timing(StageTimings::Convert, i);
+            cv::cvtColor(frame, display, cv::COLOR_BGR2BGRA);
+            QImage image(display.data, display.cols, display.rows, display.step, QImage::Format_RGB32);
+            Q_UNUSED(image);
+        }
+        {
+            StageTimings::Scope timing(StageTimings::Encode, i);
+            writer.write(frame);
+        }
+        ++frames;
+    }
+    double wall_ms = timer.nsecsElapsed()/1e6;
+    writer.release();
+    // a short run is reported, but it did not time the configured work
+    int exit_code = 0;
+    if(frames < c.frames) {
+        qWarning() << "decoded only" << frames << "of" << c.frames << "frames";
+        exit_code = 1;
+    }
+
+    QJsonObject config;
+    config["width"] = c.width;
+    config["height"] = c.height;
+    config["frames"] = c.frames;
+    config["fps"] = c.fps;
+    config["sample_rate"] = c.sample_rate;
+    config["series"] = c.series;
+    config["rotation"] = c.rotation;
+    config["fixed_limits"] = c.fixed_limits;
+    config["smooth_scale_y"] = c.smooth_scale_y;
+    config["format"] = c.format;
+
+    QJsonObject host;
+    host["cpu"] = QSysInfo::currentCpuArchitecture();
+    host["os"] = QSysInfo::prettyProductName();
+    host["threads"] = QThread::idealThreadCount();
+    host["opencv"] = QString(CV_VERSION);
+
+    QJsonArray stages;
+    for(int stage = 0; stage < StageTimings::StageCount; ++stage) {
+        StageTimings::Summary s = timings.summary(static_cast<StageTimings::Stage>(stage));
+        QJsonObject entry;
+        entry["stage"] = StageTimings::stageName(static_cast<StageTimings::Stage>(stage));
+        entry["count"] = static_cast<double>(s.count);
+        entry["mean_ms"] = s.mean_ms;
+        entry["p50_ms"] = s.p50_ms;
+        entry["p99_ms"] = s.p99_ms;
+        entry["max_ms"] = s.max_ms;
+        entry["throughput_fps"] = s.mean_ms > 0.0 ? 1000.0/s.mean_ms : 0.0;
+        stages.append(entry);
+    }
+
+    QJsonObject result;
+    result["config"] = config;
+    result["host"] = host;
+    result["csv_rows"] = data->count();
+    result["csv_load_ms"] = csv_load_ms;
+    result["csv_reload_ms"] = csv_reload_ms;
+    result["frames"] = frames;
+    result["wall_ms"] = wall_ms;
+    result["wall_fps"] = wall_ms > 0.0 ? frames*1000.0/wall_ms : 0.0;
+    result["stages"] = stages;
+
+    QByteArray text;
+    if(output_file.endsWith(".csv", Qt::CaseInsensitive)) {
+        // one row per stage; loading and the whole loop as extra rows
+        text = "stage,count,mean_ms,p50_ms,p99_ms,max_ms,throughput_fps\n";
+        text += QString("csv load,1,%1,%1,%1,%1,\n").arg(csv_load_ms, 0, 'f', 4).toUtf8();
+        text += QString("csv reload,1,%1,%1,%1,%1,\n").arg(csv_reload_ms, 0, 'f', 4).toUtf8();
+        for(const QJsonValue &value : stages) {
+            QJsonObject s = value.toObject();
+            text += QString("%1,%2,%3,%4,%5,%6,%7\n")
+                    .arg(s["stage"].toString()).arg(s["count"].toInt())
+                    .arg(s["mean_ms"].toDouble(), 0, 'f', 4).arg(s["p50_ms"].toDouble(), 0, 'f', 4)
+                    .arg(s["p99_ms"].toDouble(), 0, 'f', 4).arg(s["max_ms"].toDouble(), 0, 'f', 4)
+                    .arg(s["throughput_fps"].toDouble(), 0, 'f', 2).toUtf8();
+        }
+        text += QString("frame,%1,%2,,,,%3\n").arg(frames)
+                .arg(frames > 0 ? wall_ms/frames : 0.0, 0, 'f', 4)
+                .arg(result["wall_fps"].toDouble(), 0, 'f', 2).toUtf8();
+    }
+    else {
+        text = QJsonDocument(result).toJson();
+    }
+
+    if(output_file.isEmpty()) {
+        fwrite(text.constData(), 1, text.size(), stdout);
+        return exit_code;
+    }
+    QSaveFile file(output_file);
+    if(!file.open(QFile::WriteOnly) || file.write(text) != text.size() || !file.commit()) {
+        qWarning() << "unable to write" << output_file;
+        return 1;
+    }
+    return exit_code;
+}
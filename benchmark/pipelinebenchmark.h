@@ -0,0 +1,42 @@
+#ifndef PIPELINEBENCHMARK_H
+#define PIPELINEBENCHMARK_H
+
+#include <QString>
+
+// Times every stage of compositing a synthetic video with a synthetic CSV,
+// the way the GUI does it frame by frame: decode, rotate, slice, plot
+// render, blend, conversion to the view's QImage format and encode. The
+// inputs are generated into a temporary directory, so runs on different
+// hosts or builds measure the same work.
+class PipelineBenchmark
+{
+public:
+    struct Config
+    {
+        int width = 1920;
+        int height = 1080;
+        int frames = 300;
+        double fps = 30.0;
+        double sample_rate = 1000.0;    // CSV rows per second of video
+        int series = 1;
+        double rotation = 0.0;
+        bool fixed_limits = false;      // the cached-axes plot path
+        bool smooth_scale_y = false;    // fixed x, smoothed autoscaled y
+        QString format = "avi";         // of the encoded output, see videoformat.h
+    };
+
+    explicit PipelineBenchmark(const Config &config);
+
+    // results as JSON, or CSV for a file name ending in .csv; empty
+    // output_file prints JSON. Returns a process exit code, which is 1
+    // also when fewer frames were decoded than generated.
+    int run(const QString &output_file);
+
+private:
+    bool writeVideo(const QString &file_name) const;
+    bool writeCsv(const QString &file_name) const;
+
+    Config m_config;
+};
+
+#endif // PIPELINEBENCHMARK_H
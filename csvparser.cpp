@@ -0,0 +1,307 @@
+#include "csvparser.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// doubles are exact up to 2^53, powers of ten up to 10^22
+const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* lineEnd(const char *pos, const char *end)
+{
+    const char *newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+    return newline ? newline : end;
+}
+
+inline bool isBlank(const char *begin, const char *end)
+{
+    for(; begin != end; ++begin) {
+        if(!isSpace(*begin)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// chunk boundaries at line starts, so no line is split between threads
+std::vector<const char*> splitChunks(const char *data, qint64 size, int chunks)
+{
+    std::vector<const char*> bounds;
+    const char *end = data + size;
+    bounds.push_back(data);
+    for(int i = 1; i < chunks; ++i) {
+        const char *pos = std::max(bounds.back(), data + size*i/chunks);
+        if(pos > data && pos[-1] != '\n') {
+            pos = lineEnd(pos, end);
+            if(pos != end) {
+                ++pos;
+            }
+        }
+        bounds.push_back(pos);
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+struct ChunkCount
+{
+    qint64 rows = 0;
+    qint64 malformed = 0;
+};
+
+ChunkCount countRows(const char *begin, const char *end, bool first_chunk)
+{
+    ChunkCount count;
+    bool first_line = first_chunk;
+    for(const char *pos = begin; pos < end; ) {
+        const char *line_end = lineEnd(pos, end);
+        if(std::memchr(pos, ',', line_end - pos)) {
+            ++count.rows;
+        }
+        else if(!first_line && !isBlank(pos, line_end)) {
+            ++count.malformed;
+        }
+        first_line = false;
+        pos = line_end == end ? end : line_end + 1;
+    }
+    return count;
+}
+
+}
+
+CsvParser::CsvParser()
+{
+}
+
+bool CsvParser::parseDouble(const char *begin, const char *end, double *value)
+{
+    while(begin != end && isSpace(*begin)) {
+        ++begin;
+    }
+    while(end != begin && isSpace(end[-1])) {
+        --end;
+    }
+    const char *pos = begin;
+
+    bool negative = false;
+    if(pos != end && (*pos == '-' || *pos == '+')) {
+        negative = *pos == '-';
+        ++pos;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    for(; pos != end && *pos >= '0' && *pos <= '9'; ++pos) {
+        any_digit = true;
+        if(mantissa || *pos != '0') {
+            mantissa = mantissa*10 + (*pos - '0');
+            ++digits;
+        }
+    }
+    if(pos != end && *pos == '.') {
+        for(++pos; pos != end && *pos >= '0' && *pos <= '9'; ++pos) {
+            any_digit = true;
+            if(mantissa || *pos != '0') {
+                mantissa = mantissa*10 + (*pos - '0');
+                ++digits;
+            }
+            --exponent;
+        }
+    }
+    if(any_digit && pos != end && (*pos == 'e' || *pos == 'E')) {
+        ++pos;
+        bool negative_exponent = false;
+        if(pos != end && (*pos == '-' || *pos == '+')) {
+            negative_exponent = *pos == '-';
+            ++pos;
+        }
+        int e = 0;
+        bool any_exponent_digit = false;
+        for(; pos != end && *pos >= '0' && *pos <= '9'; ++pos) {
+            any_exponent_digit = true;
+            if(e < 100000) {
+                e = e*10 + (*pos - '0');
+            }
+        }
+        if(!any_exponent_digit) {
+            any_digit = false;
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+
+    // fast path: mantissa and power of ten are both exact, so one
+    // multiplication or division rounds correctly
+    if(any_digit && pos == end && digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double result = static_cast<double>(mantissa);
+        if(exponent < 0) {
+            result /= exact_powers_of_ten[-exponent];
+        }
+        else {
+            result *= exact_powers_of_ten[exponent];
+        }
+        *value = negative ? -result : result;
+        return true;
+    }
+
+    // long mantissas, large exponents, nan/inf: let Qt's C-locale parser round
+    bool ok = false;
+    *value = QByteArray(begin, static_cast<int>(end - begin)).toDouble(&ok);
+    if(!ok) {
+        *value = 0.0;
+    }
+    return ok;
+}
+
+CsvParser::Result CsvParser::parseFile(const QString &file_name) const
+{
+    QFile file(file_name);
+    if(!file.open(QFile::ReadOnly)) {
+        return Result();
+    }
+    qint64 size = file.size();
+    if(size == 0) {
+        Result result;
+        result.column_count = 2;
+        result.ok = true;
+        return result;
+    }
+
+    // map rather than read so the text never has to sit on the heap
+    uchar *map = file.map(0, size);
+    if(map) {
+        Result result = parse(reinterpret_cast<const char*>(map), size);
+        file.unmap(map);
+        return result;
+    }
+    QByteArray data = file.readAll();
+    return parse(data.constData(), data.size());
+}
+
+CsvParser::Result CsvParser::parse(const char *data, qint64 size) const
+{
+    Result result;
+    const char *end = data + size;
+
+    // the header candidate: the first line split as text. It also sets
+    // how many columns every row is read into.
+    const char *first_end = lineEnd(data, end);
+    if(std::memchr(data, ',', first_end - data)) {
+        for(const char *pos = data; ; ) {
+            const char *field_end = static_cast<const char*>(std::memchr(pos, ',', first_end - pos));
+            if(!field_end) {
+                field_end = first_end;
+            }
+            result.header << QString::fromUtf8(pos, static_cast<int>(field_end - pos)).trimmed();
+            if(field_end == first_end) {
+                break;
+            }
+            pos = field_end + 1;
+        }
+        result.first_line_is_row = true;
+    }
+    result.column_count = std::max(2, result.header.length());
+    const int columns = result.column_count;
+
+    int threads = m_threads > 0 ? m_threads : std::max(1u, std::thread::hardware_concurrency());
+    // not worth a thread below a megabyte
+    threads = static_cast<int>(std::max<qint64>(1, std::min<qint64>(threads, size/(1 << 20))));
+    std::vector<const char*> bounds = splitChunks(data, size, threads);
+
+    // pass 1: rows per chunk
+    std::vector<ChunkCount> counts(threads);
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&, i]{
+            counts[i] = countRows(bounds[i], bounds[i + 1], i == 0);
+        }));
+    }
+    for(std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    std::vector<qint64> first_row(threads + 1, 0);
+    for(int i = 0; i < threads; ++i) {
+        first_row[i + 1] = first_row[i] + counts[i].rows;
+        result.malformed_rows += counts[i].malformed;
+    }
+    const qint64 rows = first_row[threads];
+    result.row_count = rows;
+    result.data.resize(rows*columns);
+
+    // pass 2: parse each chunk into its slice of every column
+    std::atomic<qint64> bytes_done(0);
+    std::atomic<qint64> bad_rows(0);
+    std::atomic<int> running(threads);
+    for(int i = 0; i < threads; ++i) {
+        workers.push_back(std::thread([&, i]{
+            double *row = result.data.data() + first_row[i];
+            qint64 bad = 0;
+            bool first_line = i == 0;
+            const char *reported = bounds[i];
+            for(const char *pos = bounds[i]; pos < bounds[i + 1]; ) {
+                const char *line_end = lineEnd(pos, bounds[i + 1]);
+                if(std::memchr(pos, ',', line_end - pos)) {
+                    bool ok = true;
+                    const char *field = pos;
+                    for(int c = 0; c < columns; ++c) {
+                        if(!field) {
+                            // short row: the missing columns have no value
+                            row[c*rows] = std::numeric_limits<double>::quiet_NaN();
+                            ok = false;
+                            continue;
+                        }
+                        const char *field_end = static_cast<const char*>(std::memchr(field, ',', line_end - field));
+                        ok = parseDouble(field, field_end ? field_end : line_end, row + c*rows) && ok;
+                        field = field_end ? field_end + 1 : nullptr;
+                    }
+                    ++row;
+                    if(!ok && !first_line) {
+                        ++bad;
+                    }
+                }
+                first_line = false;
+                pos = line_end == bounds[i + 1] ? line_end : line_end + 1;
+                if(pos - reported > (1 << 20)) {
+                    bytes_done += pos - reported;
+                    reported = pos;
+                }
+            }
+            bytes_done += bounds[i + 1] - reported;
+            bad_rows += bad;
+            --running;
+        }));
+    }
+    while(m_progress && running > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        m_progress(bytes_done, size);
+    }
+    for(std::thread &worker : workers) {
+        worker.join();
+    }
+    if(m_progress) {
+        m_progress(size, size);
+    }
+
+    result.malformed_rows += bad_rows;
+    result.ok = true;
+    return result;
+}
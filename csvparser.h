@@ -0,0 +1,56 @@
+#ifndef CSVPARSER_H
+#define CSVPARSER_H
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <vector>
+
+// Parses "x,y[,y2...]" CSV text on all cores; the first line decides how
+// many columns are read. The input is cut into chunks at line boundaries;
+// a first pass counts rows per chunk so the second pass can write every
+// chunk straight into its place in the output columns. Numbers are parsed
+// without QString or the locale.
+class CsvParser
+{
+public:
+    struct Result
+    {
+        // column-major: column c starts at data[c*row_count]
+        std::vector<double> data;
+        qint64 row_count = 0;
+        int column_count = 0;
+        // the first line split as text, in case it holds column names
+        QStringList header;
+        bool first_line_is_row = false;
+        // rows after the first line that had fewer than two fields, fewer
+        // fields than the first line or fields that are not numbers.
+        // Unreadable numbers are 0 like before, missing columns NaN.
+        qint64 malformed_rows = 0;
+        bool ok = false;
+
+        const double* column(int c) const { return data.data() + c*row_count; }
+    };
+
+    // bytes_done of bytes_total parsed; called every 20 ms on the thread
+    // that called parse() or parseFile(), while the workers run
+    typedef std::function<void(qint64 bytes_done, qint64 bytes_total)> ProgressCallback;
+
+    CsvParser();
+
+    // 0 picks one thread per core
+    void setThreadCount(int threads) { m_threads = threads; }
+    void setProgressCallback(const ProgressCallback &progress) { m_progress = progress; }
+
+    Result parseFile(const QString &file_name) const;
+    Result parse(const char *data, qint64 size) const;
+
+    // locale independent; leading and trailing whitespace is ignored
+    static bool parseDouble(const char *begin, const char *end, double *value);
+
+private:
+    int m_threads = 0;
+    ProgressCallback m_progress;
+};
+
+#endif // CSVPARSER_H
@@ -0,0 +1,102 @@
+#include "framecache.h"
+
+namespace {
+
+long long frameBytes(const cv::Mat &frame)
+{
+    return static_cast<long long>(frame.total())*frame.elemSize();
+}
+
+}
+
+FrameCache::FrameCache()
+{
+}
+
+void FrameCache::setBudget(long long bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytes;
+    evict();
+}
+
+long long FrameCache::budget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+bool FrameCache::find(int index, cv::Mat &frame)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_lookup.find(index);
+    if(it == m_lookup.end()) {
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    m_frames.splice(m_frames.begin(), m_frames, it->second);
+    // cached frames are never written to, so the copy can run unlocked
+    cv::Mat cached = it->second->second;
+    lock.unlock();
+    cached.copyTo(frame);
+    return true;
+}
+
+bool FrameCache::contains(int index) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lookup.count(index) > 0;
+}
+
+void FrameCache::insert(int index, const cv::Mat &frame)
+{
+    long long bytes = frameBytes(frame);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(frame.empty() || bytes > m_budget || m_lookup.count(index)) {
+            return;
+        }
+    }
+    cv::Mat copy = frame.clone();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_lookup.count(index)) {
+        return;
+    }
+    m_frames.emplace_front(index, copy);
+    m_lookup[index] = m_frames.begin();
+    m_bytes += bytes;
+    evict();
+}
+
+void FrameCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frames.clear();
+    m_lookup.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+}
+
+FrameCache::Stats FrameCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.frames = static_cast<int>(m_frames.size());
+    stats.bytes = m_bytes;
+    stats.budget = m_budget;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    return stats;
+}
+
+void FrameCache::evict()
+{
+    while(m_bytes > m_budget && !m_frames.empty()) {
+        m_bytes -= frameBytes(m_frames.back().second);
+        m_lookup.erase(m_frames.back().first);
+        m_frames.pop_back();
+    }
+}
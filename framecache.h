@@ -0,0 +1,54 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <opencv2/core.hpp>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Decoded frames by frame index, least recently used dropped first once
+// the memory budget is exceeded. Safe to use from the pipeline decoder
+// while the UI reads the stats.
+class FrameCache
+{
+public:
+    struct Stats
+    {
+        int frames = 0;
+        long long bytes = 0;
+        long long budget = 0;
+        long long hits = 0;
+        long long misses = 0;
+    };
+
+    FrameCache();
+
+    // 0 disables the cache
+    void setBudget(long long bytes);
+    long long budget() const;
+
+    // copy the cached frame into frame; counts a hit or a miss
+    bool find(int index, cv::Mat &frame);
+    bool contains(int index) const;
+    // keeps a copy of frame if it fits the budget
+    void insert(int index, const cv::Mat &frame);
+    void clear();
+
+    Stats stats() const;
+
+private:
+    typedef std::list<std::pair<int, cv::Mat>> FrameList;
+
+    void evict();
+
+    mutable std::mutex m_mutex;
+    // most recently used first
+    FrameList m_frames;
+    std::unordered_map<int, FrameList::iterator> m_lookup;
+    long long m_bytes = 0;
+    long long m_budget = 0;
+    long long m_hits = 0;
+    long long m_misses = 0;
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,705 @@
+#include "framecompositor.h"
+#include "overlayblend.h"
+#include "livesource.h"
+#include "stagetimings.h"
+
+#include <opencv2/imgproc.hpp>
+#include <QSettings>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+#define CVPLOT_HEADER_ONLY
+#include <CvPlot/cvplot.h>
+
+cv::Scalar SeriesStyle::defaultColor(int n)
+{
+    static const cv::Scalar palette[] = {
+        cv::Scalar(255, 0, 0),      // blue
+        cv::Scalar(0, 0, 255),      // red
+        cv::Scalar(0, 160, 0),      // green
+        cv::Scalar(0, 140, 255),    // orange
+        cv::Scalar(200, 0, 200),    // magenta
+        cv::Scalar(200, 200, 0),    // cyan
+        cv::Scalar(40, 40, 40),     // black
+        cv::Scalar(0, 200, 200)     // yellow
+    };
+    return palette[n % (sizeof(palette)/sizeof(palette[0]))];
+}
+
+// source position of every output pixel of a warp, in OpenCV's fixed
+// point format: integer positions plus an index into its table of
+// bilinear weights
+struct WarpMaps
+{
+    cv::Size source_size;
+    cv::Size output_size;
+    cv::Matx23d matrix;
+    cv::Mat positions;  // CV_16SC2
+    cv::Mat weights;    // CV_16UC1
+
+    bool matches(cv::Size source, const cv::Matx23d &m, cv::Size output) const
+    {
+        return source == source_size && output == output_size && m == matrix;
+    }
+};
+
+// built once per geometry and shared, so pipeline workers do not each
+// hold their own copy of the tables
+static std::shared_ptr<const WarpMaps> warpMaps(cv::Size source, const cv::Matx23d &m, cv::Size output)
+{
+    static std::mutex mutex;
+    static std::weak_ptr<const WarpMaps> last;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const WarpMaps> maps = last.lock();
+    if(maps && maps->matches(source, m, output)) {
+        return maps;
+    }
+
+    std::shared_ptr<WarpMaps> built = std::make_shared<WarpMaps>();
+    built->source_size = source;
+    built->output_size = output;
+    built->matrix = m;
+    cv::Matx23d inverse;
+    cv::invertAffineTransform(m, inverse);
+    cv::Mat2f positions(output);
+    for(int y = 0; y < output.height; ++y) {
+        cv::Vec2f *row = positions.ptr<cv::Vec2f>(y);
+        for(int x = 0; x < output.width; ++x) {
+            row[x][0] = static_cast<float>(inverse(0, 0)*x + inverse(0, 1)*y + inverse(0, 2));
+            row[x][1] = static_cast<float>(inverse(1, 0)*x + inverse(1, 1)*y + inverse(1, 2));
+        }
+    }
+    cv::convertMaps(positions, cv::Mat(), built->positions, built->weights, CV_16SC2);
+    last = built;
+    return built;
+}
+
+// colors are stored as #rrggbb so the files stay readable
+static QString colorName(const cv::Scalar &color)
+{
+    return QString("#%1%2%3")
+            .arg(static_cast<int>(color[2]), 2, 16, QChar('0'))
+            .arg(static_cast<int>(color[1]), 2, 16, QChar('0'))
+            .arg(static_cast<int>(color[0]), 2, 16, QChar('0'));
+}
+
+static cv::Scalar colorFromName(const QString &name, const cv::Scalar &fallback)
+{
+    bool ok = false;
+    uint rgb = name.mid(1).toUInt(&ok, 16);
+    if(!name.startsWith("#") || name.length() != 7 || !ok) {
+        return fallback;
+    }
+    return cv::Scalar(rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff);
+}
+
+cv::Rect CompositorSettings::cropRect(cv::Size source_size) const
+{
+    cv::Rect frame(cv::Point(), source_size);
+    cv::Rect c = crop & frame;
+    return c.area() > 0 ? c : frame;
+}
+
+cv::Size CompositorSettings::outputSize(cv::Size source_size) const
+{
+    cv::Size c = cropRect(source_size).size();
+    if(c.area() <= 0) {
+        return c;
+    }
+    int w = output_size.width;
+    int h = output_size.height;
+    if(w <= 0 && h <= 0) {
+        return c;
+    }
+    if(h <= 0) {
+        h = std::max(1, static_cast<int>(std::lround(static_cast<double>(w)*c.height/c.width)));
+    }
+    else if(w <= 0) {
+        w = std::max(1, static_cast<int>(std::lround(static_cast<double>(h)*c.width/c.height)));
+    }
+    return cv::Size(w, h);
+}
+
+cv::Matx23d CompositorSettings::transformMatrix(cv::Size source_size) const
+{
+    cv::Rect c = cropRect(source_size);
+    cv::Size out = outputSize(source_size);
+    cv::Point2f center(source_size.width/2., source_size.height/2.);
+    cv::Mat r = cv::getRotationMatrix2D(center, rotation, scale);
+    // rotated, shifted to the crop, then resized
+    double kx = c.width > 0 ? static_cast<double>(out.width)/c.width : 1.0;
+    double ky = c.height > 0 ? static_cast<double>(out.height)/c.height : 1.0;
+    cv::Matx23d m;
+    for(int j = 0; j < 3; ++j) {
+        m(0, j) = r.at<double>(0, j)*kx;
+        m(1, j) = r.at<double>(1, j)*ky;
+    }
+    m(0, 2) -= c.x*kx;
+    m(1, 2) -= c.y*ky;
+    return m;
+}
+
+void CompositorSettings::save(QSettings &settings) const
+{
+    settings.beginGroup("video");
+    settings.setValue("rotation", rotation);
+    settings.setValue("scale", scale);
+    settings.setValue("cropX", crop.x);
+    settings.setValue("cropY", crop.y);
+    settings.setValue("cropWidth", crop.width);
+    settings.setValue("cropHeight", crop.height);
+    settings.setValue("outputWidth", output_size.width);
+    settings.setValue("outputHeight", output_size.height);
+    settings.setValue("fps", fps);
+    settings.endGroup();
+
+    settings.beginGroup("graph");
+    settings.setValue("x", graph_rect.x);
+    settings.setValue("y", graph_rect.y);
+    settings.setValue("width", graph_rect.width);
+    settings.setValue("height", graph_rect.height);
+    settings.setValue("alpha", alpha);
+    settings.setValue("lineWeight", line_weight);
+    settings.setValue("marginLeft", margin_left);
+    settings.setValue("marginRight", margin_right);
+    settings.setValue("marginTop", margin_top);
+    settings.setValue("marginBottom", margin_bottom);
+    settings.setValue("xLabel", QString::fromStdString(x_label));
+    settings.setValue("yLabel", QString::fromStdString(y_label));
+    settings.setValue("tightenX", tighten_x);
+    settings.setValue("tightenY", tighten_y);
+    settings.setValue("autoScaleX", auto_scale_x);
+    settings.setValue("autoScaleY", auto_scale_y);
+    settings.setValue("xMin", x_min);
+    settings.setValue("xMax", x_max);
+    settings.setValue("yMin", y_min);
+    settings.setValue("yMax", y_max);
+    settings.setValue("smoothScaleY", smooth_scale_y);
+    settings.setValue("xOffset", x_offset);
+    settings.setValue("xRate", x_rate);
+    settings.setValue("xWindow", x_window);
+    settings.setValue("alignTimestamps", align_timestamps);
+    settings.setValue("keyOffset", key_offset);
+    settings.setValue("keyRate", key_rate);
+    settings.setValue("driftPpm", drift_ppm);
+    settings.endGroup();
+
+    settings.beginWriteArray("series", static_cast<int>(series.size()));
+    for(size_t i = 0; i < series.size(); ++i) {
+        settings.setArrayIndex(static_cast<int>(i));
+        settings.setValue("column", series[i].column);
+        settings.setValue("color", colorName(series[i].color));
+    }
+    settings.endArray();
+}
+
+CompositorSettings CompositorSettings::load(QSettings &settings)
+{
+    CompositorSettings s;
+
+    settings.beginGroup("video");
+    s.rotation = settings.value("rotation", s.rotation).toDouble();
+    s.scale = settings.value("scale", s.scale).toDouble();
+    s.crop.x = settings.value("cropX", 0).toInt();
+    s.crop.y = settings.value("cropY", 0).toInt();
+    s.crop.width = settings.value("cropWidth", 0).toInt();
+    s.crop.height = settings.value("cropHeight", 0).toInt();
+    s.output_size.width = settings.value("outputWidth", 0).toInt();
+    s.output_size.height = settings.value("outputHeight", 0).toInt();
+    s.fps = settings.value("fps", s.fps).toDouble();
+    settings.endGroup();
+
+    settings.beginGroup("graph");
+    s.graph_rect.x = settings.value("x", 0).toInt();
+    s.graph_rect.y = settings.value("y", 0).toInt();
+    s.graph_rect.width = settings.value("width", 0).toInt();
+    s.graph_rect.height = settings.value("height", 0).toInt();
+    s.alpha = settings.value("alpha", s.alpha).toDouble();
+    s.line_weight = settings.value("lineWeight", s.line_weight).toInt();
+    s.margin_left = settings.value("marginLeft", s.margin_left).toInt();
+    s.margin_right = settings.value("marginRight", s.margin_right).toInt();
+    s.margin_top = settings.value("marginTop", s.margin_top).toInt();
+    s.margin_bottom = settings.value("marginBottom", s.margin_bottom).toInt();
+    s.x_label = settings.value("xLabel").toString().toStdString();
+    s.y_label = settings.value("yLabel").toString().toStdString();
+    s.tighten_x = settings.value("tightenX", s.tighten_x).toBool();
+    s.tighten_y = settings.value("tightenY", s.tighten_y).toBool();
+    s.auto_scale_x = settings.value("autoScaleX", s.auto_scale_x).toBool();
+    s.auto_scale_y = settings.value("autoScaleY", s.auto_scale_y).toBool();
+    s.x_min = settings.value("xMin", s.x_min).toDouble();
+    s.x_max = settings.value("xMax", s.x_max).toDouble();
+    s.y_min = settings.value("yMin", s.y_min).toDouble();
+    s.y_max = settings.value("yMax", s.y_max).toDouble();
+    s.smooth_scale_y = settings.value("smoothScaleY", s.smooth_scale_y).toBool();
+    s.x_offset = settings.value("xOffset", s.x_offset).toInt();
+    s.x_rate = settings.value("xRate", s.x_rate).toInt();
+    s.x_window = settings.value("xWindow", s.x_window).toInt();
+    s.align_timestamps = settings.value("alignTimestamps", s.align_timestamps).toBool();
+    s.key_offset = settings.value("keyOffset", s.key_offset).toDouble();
+    s.key_rate = settings.value("keyRate", s.key_rate).toDouble();
+    s.drift_ppm = settings.value("driftPpm", s.drift_ppm).toDouble();
+    settings.endGroup();
+
+    int series_count = settings.beginReadArray("series");
+    if(series_count > 0) {
+        s.series.clear();
+        for(int i = 0; i < series_count; ++i) {
+            settings.setArrayIndex(i);
+            SeriesStyle style;
+            style.column = settings.value("column", 1).toInt();
+            style.color = colorFromName(settings.value("color").toString(), SeriesStyle::defaultColor(i));
+            s.series.push_back(style);
+        }
+    }
+    settings.endArray();
+
+    return s;
+}
+
+// true if both settings produce the same axes background
+static bool sameAxes(const CompositorSettings &a, const CompositorSettings &b)
+{
+    return a.margin_left == b.margin_left && a.margin_right == b.margin_right
+            && a.margin_top == b.margin_top && a.margin_bottom == b.margin_bottom
+            && a.x_label == b.x_label && a.y_label == b.y_label
+            && a.auto_scale_x == b.auto_scale_x && a.auto_scale_y == b.auto_scale_y
+            && a.x_min == b.x_min && a.x_max == b.x_max
+            && a.y_min == b.y_min && a.y_max == b.y_max
+            && a.smooth_scale_y == b.smooth_scale_y && a.tighten_x == b.tighten_x
+            && a.tighten_y == b.tighten_y;
+}
+
+static void setupAxes(CvPlot::Axes &axes, const CompositorSettings &s)
+{
+    axes.setMargins(s.margin_left, s.margin_right, s.margin_top, s.margin_bottom);
+
+    axes.enableHorizontalGrid();
+
+    axes.xLabel(s.x_label);
+    axes.yLabel(s.y_label);
+
+    // check tightness
+    if(s.tighten_x) {
+        axes.setXTight(true);
+    }
+    if(s.tighten_y) {
+        axes.setYTight(true);
+    }
+
+    // check axes scaling
+    if(s.auto_scale_x){
+        axes.setXLimAuto(true);
+    }
+    else {
+        axes.setXLimAuto(false);
+        axes.setXLim(std::pair<double,double>(s.x_min, s.x_max));
+    }
+    if(s.auto_scale_y){
+        axes.setYLimAuto(true);
+    }
+    else {
+        axes.setYLimAuto(false);
+        axes.setYLim(std::pair<double,double>(s.y_min, s.y_max));
+    }
+}
+
+FrameCompositor::FrameCompositor()
+{
+}
+
+FrameCompositor::~FrameCompositor()
+{
+}
+
+void FrameCompositor::setSettings(const CompositorSettings &settings)
+{
+    if(!sameAxes(settings, m_settings)) {
+        m_axes_layer.release();
+        m_x_min = m_x_max = m_y_min = m_y_max = std::numeric_limits<double>::quiet_NaN();
+    }
+    m_settings = settings;
+}
+
+void FrameCompositor::setGraphData(const std::shared_ptr<const GraphData> &data)
+{
+    m_data = data;
+}
+
+void FrameCompositor::setLiveSource(const std::shared_ptr<const LiveSource> &live)
+{
+    m_live = live;
+    m_live_count = 0;
+    m_live_columns = 0;
+}
+
+cv::Rect FrameCompositor::compose(cv::Mat &frame, int frame_index, double time_ms)
+{
+    transform(frame);
+    return blend(frame, frame_index, time_ms);
+}
+
+void FrameCompositor::transform(cv::Mat &frame)
+{
+    if(frame.empty() || isIdentity(frame.size())) {
+        return;
+    }
+    // warp into the spare buffer and trade it for the source, so neither
+    // is allocated again for the next frame of the same size
+    warp(frame, m_warped);
+    cv::swap(frame, m_warped);
+}
+
+void FrameCompositor::transform(cv::Mat &source, cv::Mat &output)
+{
+    if(source.empty() || isIdentity(source.size())) {
+        cv::swap(source, output);
+        return;
+    }
+    warp(source, output);
+}
+
+bool FrameCompositor::isIdentity(cv::Size source_size) const
+{
+    const CompositorSettings &s = m_settings;
+    return s.outputSize(source_size) == source_size
+            && s.transformMatrix(source_size) == cv::Matx23d(1, 0, 0, 0, 1, 0);
+}
+
+void FrameCompositor::warp(const cv::Mat &source, cv::Mat &output)
+{
+    const CompositorSettings &s = m_settings;
+    cv::Size out = s.outputSize(source.size());
+    cv::Matx23d m = s.transformMatrix(source.size());
+    StageTimings::Scope timing(StageTimings::Rotate);
+    // every output pixel is sampled once from the source; pixels outside
+    // the crop are never read
+    if(m(0, 1) == 0.0 && m(1, 0) == 0.0 && m(0, 0) > 0.0 && m(1, 1) > 0.0) {
+        // without rotation the output shows a rectangle of the source;
+        // cut it out and resize it, averaging when scaled down
+        cv::Rect roi(cvRound(-m(0, 2)/m(0, 0)), cvRound(-m(1, 2)/m(1, 1)),
+                     cvRound(out.width/m(0, 0)), cvRound(out.height/m(1, 1)));
+        if(roi.area() > 0 && (roi & cv::Rect(0, 0, source.cols, source.rows)) == roi) {
+            if(roi.size() == out) {
+                source(roi).copyTo(output);
+            }
+            else {
+                bool shrink = roi.width > out.width || roi.height > out.height;
+                cv::resize(source(roi), output, out, 0, 0, shrink ? cv::INTER_AREA : cv::INTER_LINEAR);
+            }
+            return;
+        }
+    }
+    // the tables only change with the geometry; remap then skips the
+    // per-pixel coordinate math warpAffine repeats for every frame
+    if(!m_warp_maps || !m_warp_maps->matches(source.size(), m, out)) {
+        m_warp_maps = warpMaps(source.size(), m, out);
+    }
+    cv::remap(source, output, m_warp_maps->positions, m_warp_maps->weights, cv::INTER_LINEAR);
+}
+
+int FrameCompositor::windowStart(int frame_index, double time_ms) const
+{
+    const CompositorSettings &s = m_settings;
+    if(s.align_timestamps && m_data && m_data->keysSorted()) {
+        if(std::isnan(time_ms)) {
+            time_ms = frame_index*1000.0/s.fps;
+        }
+        double key = s.key_offset + time_ms/1000.0*s.key_rate*(1.0 + s.drift_ppm*1e-6);
+        return s.x_offset + m_data->rowAtKey(key);
+    }
+
+    // calculate data rate relative to video frame rate
+    double coeff = static_cast<double>(s.x_rate)/s.fps;
+    return s.x_offset + frame_index*coeff;
+}
+
+cv::Rect FrameCompositor::blend(cv::Mat &frame, int frame_index, double time_ms)
+{
+    if(frame.empty()) {
+        return cv::Rect();
+    }
+    const CompositorSettings &s = m_settings;
+
+    // the graph must lie inside the frame; nothing outside it is touched
+    cv::Rect rect = s.graph_rect & cv::Rect(0, 0, frame.cols, frame.rows);
+    if(rect.area() <= 0) {
+        return cv::Rect();
+    }
+
+    // one window for every series
+    {
+        StageTimings::Scope timing(StageTimings::Slice, frame_index);
+        int first = 0;
+        int last = 0;
+        if(m_live) {
+            // a copy, so the reader keeps appending while this frame is drawn
+            std::shared_ptr<const SampleRing> ring = m_live->ring();
+            m_live_count = ring ? ring->newest(s.x_window, m_live_samples) : 0;
+            m_live_columns = ring ? ring->columnCount() : 0;
+            last = m_live_count;
+        }
+        else if(m_data) {
+            int offset = windowStart(frame_index, time_ms);
+            first = std::max(offset, 0);
+            last = std::max(first, std::min(offset + s.x_window, m_data->count()));
+        }
+        m_spans.resize(s.series.size());
+        m_keys.resize(s.series.size());
+        m_values.resize(s.series.size());
+        for(size_t i = 0; i < s.series.size(); ++i) {
+            m_spans[i] = seriesWindow(i, rect.size(), first, last);
+        }
+        updateLimits(first, last);
+    }
+
+    {
+        StageTimings::Scope timing(StageTimings::PlotRender, frame_index);
+        renderPlot(rect.size());
+    }
+
+    // transparent plot background, opaque lines, both scaled by alpha
+    StageTimings::Scope timing(StageTimings::Blend, frame_index);
+    OverlayBlend::premultiply(m_graph, s.alpha, m_overlay_color, m_overlay_inverse_alpha);
+    cv::Mat roi = frame(rect);
+    OverlayBlend::blend(m_overlay_color, m_overlay_inverse_alpha, roi);
+    return rect;
+}
+
+// about two points per pixel column of the plot area are enough
+static int maxPoints(cv::Size size, const CompositorSettings &s)
+{
+    return 2*std::max(size.width - s.margin_left - s.margin_right, 1);
+}
+
+// a step of 1, 2 or 5 times a power of ten close to raw
+static double niceStep(double raw)
+{
+    double power = std::pow(10.0, std::floor(std::log10(raw)));
+    double fraction = raw/power;
+    return (fraction <= 1.0 ? 1.0 : fraction <= 2.0 ? 2.0 : fraction <= 5.0 ? 5.0 : 10.0)*power;
+}
+
+// limits for data in [lo, hi], padded by 5% unless tight. Smoothed limits
+// round outwards to about a tenth of the range and keep min and max while
+// the data stays inside and fills at least half of them.
+static void autoLimits(double lo, double hi, bool tight, bool smooth, double &min, double &max)
+{
+    if(hi <= lo) {
+        double pad = lo != 0.0 ? std::abs(lo)*0.05 : 0.5;
+        lo -= pad;
+        hi += pad;
+    }
+    else if(!tight) {
+        double pad = (hi - lo)*0.05;
+        lo -= pad;
+        hi += pad;
+    }
+    if(!smooth) {
+        min = lo;
+        max = hi;
+        return;
+    }
+    // NaN limits compare false, so the first window always snaps
+    if(lo >= min && hi <= max && hi - lo >= 0.5*(max - min)) {
+        return;
+    }
+    double step = niceStep((hi - lo)/10.0);
+    min = std::floor(lo/step)*step;
+    max = std::ceil(hi/step)*step;
+}
+
+void FrameCompositor::updateLimits(int first, int last)
+{
+    const CompositorSettings &s = m_settings;
+    double lo = 0.0;
+    double hi = 0.0;
+    if(!s.auto_scale_x) {
+        m_x_min = s.x_min;
+        m_x_max = s.x_max;
+    }
+    else if(keyRange(first, last, lo, hi)) {
+        autoLimits(lo, hi, s.tighten_x, false, m_x_min, m_x_max);
+    }
+    if(!s.auto_scale_y) {
+        m_y_min = s.y_min;
+        m_y_max = s.y_max;
+    }
+    else if(valueRange(first, last, lo, hi)) {
+        autoLimits(lo, hi, s.tighten_y, s.smooth_scale_y, m_y_min, m_y_max);
+    }
+    // nothing to scale to yet, or fixed limits without a range
+    if(std::isnan(m_x_min) || std::isnan(m_x_max)) {
+        m_x_min = 0.0;
+        m_x_max = 1.0;
+    }
+    else if(m_x_max <= m_x_min) {
+        m_x_max = m_x_min + 0.5;
+        m_x_min -= 0.5;
+    }
+    if(std::isnan(m_y_min) || std::isnan(m_y_max)) {
+        m_y_min = 0.0;
+        m_y_max = 1.0;
+    }
+    else if(m_y_max <= m_y_min) {
+        m_y_max = m_y_min + 0.5;
+        m_y_min -= 0.5;
+    }
+}
+
+bool FrameCompositor::keyRange(int first, int last, double &min, double &max) const
+{
+    if(!m_live) {
+        return m_data && m_data->range(0, first, last, min, max);
+    }
+    // live windows are a copy; the decimated spans keep their extremes
+    bool found = false;
+    for(const GraphData::Span &span : m_spans) {
+        for(int i = 0; i < span.count; ++i) {
+            double key = span.keys[i];
+            if(!std::isnan(key)) {
+                min = found ? std::min(min, key) : key;
+                max = found ? std::max(max, key) : key;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool FrameCompositor::valueRange(int first, int last, double &min, double &max) const
+{
+    bool found = false;
+    for(size_t i = 0; i < m_spans.size(); ++i) {
+        double lo = 0.0;
+        double hi = 0.0;
+        if(!m_live) {
+            // O(log n) from the column's pyramid, however wide the window
+            if(!m_data || !m_data->range(m_settings.series[i].column, first, last, lo, hi)) {
+                continue;
+            }
+        }
+        else {
+            const GraphData::Span &span = m_spans[i];
+            bool any = false;
+            for(int j = 0; j < span.count; ++j) {
+                double value = span.values[j];
+                if(!std::isnan(value)) {
+                    lo = any ? std::min(lo, value) : value;
+                    hi = any ? std::max(hi, value) : value;
+                    any = true;
+                }
+            }
+            if(!any) {
+                continue;
+            }
+        }
+        min = found ? std::min(min, lo) : lo;
+        max = found ? std::max(max, hi) : hi;
+        found = true;
+    }
+    return found;
+}
+
+int FrameCompositor::columnCount() const
+{
+    if(m_live) {
+        return m_live_columns;
+    }
+    return m_data ? m_data->columnCount() : 0;
+}
+
+// keeps the x range of keys[first, last) for a column that cannot be drawn
+static GraphData::Span emptyWindow(const double *keys, int first, int last,
+                                   std::vector<double> &keys_buffer, std::vector<double> &values_buffer)
+{
+    GraphData::Span span;
+    keys_buffer.clear();
+    if(keys && last > first) {
+        keys_buffer.push_back(keys[first]);
+        keys_buffer.push_back(keys[last - 1]);
+    }
+    values_buffer.assign(keys_buffer.size(), std::numeric_limits<double>::quiet_NaN());
+    span.keys = keys_buffer.data();
+    span.values = values_buffer.data();
+    span.count = static_cast<int>(keys_buffer.size());
+    return span;
+}
+
+GraphData::Span FrameCompositor::seriesWindow(size_t i, cv::Size size, int first, int last)
+{
+    if(m_live) {
+        return liveWindow(i, size);
+    }
+    int column = m_settings.series[i].column;
+    if(m_data && column > 0 && column < m_data->columnCount()) {
+        return m_data->window(column, first, last, maxPoints(size, m_settings), m_keys[i], m_values[i]);
+    }
+    return emptyWindow(m_data ? m_data->keys() : nullptr, first, last, m_keys[i], m_values[i]);
+}
+
+GraphData::Span FrameCompositor::liveWindow(size_t i, cv::Size size)
+{
+    const double *keys = m_live_samples.data();
+    int column = m_settings.series[i].column;
+    if(column <= 0 || column >= m_live_columns) {
+        return emptyWindow(keys, 0, m_live_count, m_keys[i], m_values[i]);
+    }
+    const double *values = keys + static_cast<size_t>(column)*m_live_count;
+    int max_points = maxPoints(size, m_settings);
+    if(m_live_count <= max_points) {
+        GraphData::Span span;
+        span.keys = keys;
+        span.values = values;
+        span.count = m_live_count;
+        return span;
+    }
+    // wide live windows are decimated like the graph data, the pyramid
+    // built over this frame's copy
+    m_live_pyramid.build(values, m_live_count);
+    m_live_pyramid.decimate(keys, 0, m_live_count, max_points, m_keys[i], m_values[i]);
+    GraphData::Span span;
+    span.keys = m_keys[i].data();
+    span.values = m_values[i].data();
+    span.count = static_cast<int>(m_keys[i].size());
+    return span;
+}
+
+void FrameCompositor::renderPlot(cv::Size size)
+{
+    const CompositorSettings &s = m_settings;
+
+    // background, grid, ticks and labels are only rendered again when the
+    // ROI size, margins, labels or limits change
+    cv::Vec4d limits(m_x_min, m_x_max, m_y_min, m_y_max);
+    if(m_axes_layer.empty() || m_axes_layer.size() != size || m_axes_layer_limits != limits) {
+        auto axes = CvPlot::makePlotAxes();
+        setupAxes(axes, s);
+        axes.setXLimAuto(false);
+        axes.setXLim(std::pair<double,double>(m_x_min, m_x_max));
+        axes.setYLimAuto(false);
+        axes.setYLim(std::pair<double,double>(m_y_min, m_y_max));
+        m_axes_layer = axes.render(size.height, size.width);
+        m_axes_layer_limits = limits;
+    }
+    m_axes_layer.copyTo(m_graph);
+
+    cv::Rect plot_rect(s.margin_left, s.margin_top,
+                       size.width - s.margin_left - s.margin_right,
+                       size.height - s.margin_top - s.margin_bottom);
+    plot_rect &= cv::Rect(0, 0, size.width, size.height);
+    if((!m_data && !m_live) || plot_rect.area() <= 0) {
+        return;
+    }
+
+    m_renderer.setViewport(plot_rect, m_x_min, m_x_max, m_y_min, m_y_max);
+    for(size_t series = 0; series < s.series.size(); ++series) {
+        const SeriesStyle &style = s.series[series];
+        if(style.column <= 0 || style.column >= columnCount()) {
+            continue;
+        }
+        const GraphData::Span &span = m_spans[series];
+        m_renderer.draw(m_graph, span.keys, span.values, span.count, style.color, s.line_weight);
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef FRAMECOMPOSITOR_H
+#define FRAMECOMPOSITOR_H
+
+#include <opencv2/core.hpp>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graphdata.h"
+#include "polylinerenderer.h"
+
+class QSettings;
+class LiveSource;
+struct WarpMaps;
+
+// one data column drawn against the key column
+struct SeriesStyle
+{
+    int column = 1;
+    cv::Scalar color = cv::Scalar(255, 0, 0);   // BGR
+
+    // distinct colors for the n-th series picked in the UI
+    static cv::Scalar defaultColor(int n);
+};
+
+// everything needed to composite a frame, copied out of the UI so the
+// compositor can run without a MainWindow
+struct CompositorSettings
+{
+    double rotation = 0.0;
+    double scale = 1.0;
+    // export geometry: crop is a region of the rotated and scaled frame,
+    // empty for all of it, resized to output_size; an empty output_size
+    // keeps the crop's size, one zero side keeps its aspect ratio
+    cv::Rect crop;
+    cv::Size output_size;
+
+    cv::Rect graph_rect;
+    double alpha = 0.85;
+    int line_weight = 2;
+    std::vector<SeriesStyle> series = std::vector<SeriesStyle>(1);
+
+    int margin_left = 120;
+    int margin_right = 30;
+    int margin_top = 40;
+    int margin_bottom = 80;
+
+    std::string x_label;
+    std::string y_label;
+
+    bool tighten_x = true;
+    bool tighten_y = false;
+    bool auto_scale_x = true;
+    bool auto_scale_y = true;
+    double x_min = 0.0;
+    double x_max = 0.0;
+    double y_min = 0.0;
+    double y_max = 0.0;
+    // autoscaled y limits snap to round steps and stay put until the data
+    // leaves them or shrinks to less than half of them
+    bool smooth_scale_y = false;
+
+    int x_offset = 0;
+    int x_rate = 50;
+    int x_window = 1000;
+    double fps = 30.0;
+
+    // match frames to rows by time instead of x_rate: the key of a frame
+    // shown at t seconds is key_offset + t*key_rate*(1 + drift_ppm/1e6),
+    // and x_offset rows are added to the row found for it
+    bool align_timestamps = false;
+    double key_offset = 0.0;
+    double key_rate = 1.0;      // key units per second of video
+    double drift_ppm = 0.0;     // data clock ahead of the video clock
+
+    // crop within a rotated and scaled frame of source_size
+    cv::Rect cropRect(cv::Size source_size) const;
+    // size of the composited frames
+    cv::Size outputSize(cv::Size source_size) const;
+    // rotation, scale, crop and resize as one map from source to output
+    // pixels
+    cv::Matx23d transformMatrix(cv::Size source_size) const;
+
+    void save(QSettings &settings) const;
+    static CompositorSettings load(QSettings &settings);
+};
+
+// warps a decoded frame to the output geometry and blends the graph window
+// for that frame into it
+class FrameCompositor
+{
+public:
+    FrameCompositor();
+    ~FrameCompositor();
+
+    void setSettings(const CompositorSettings &settings);
+    const CompositorSettings& settings() const { return m_settings; }
+
+    void setGraphData(const std::shared_ptr<const GraphData> &data);
+    // while set, every frame shows the newest x_window samples of the
+    // live source instead of its window of the graph data
+    void setLiveSource(const std::shared_ptr<const LiveSource> &live);
+
+    // transform and blend; returns the part of the frame the graph covers.
+    // time_ms is the frame's presentation time; NaN derives it from fps
+    cv::Rect compose(cv::Mat &frame, int frame_index,
+                     double time_ms = std::numeric_limits<double>::quiet_NaN());
+
+    // rotate, scale, crop and resize in one pass; frame ends up in a
+    // different buffer of the output size, or is left alone for the
+    // identity
+    void transform(cv::Mat &frame);
+    // the same from source into output, reusing output's buffer; for the
+    // identity the two are swapped. Keeps decode buffers at the source
+    // size when the output size differs.
+    void transform(cv::Mat &source, cv::Mat &output);
+    // blend the graph window for frame_index into the graph rect only
+    cv::Rect blend(cv::Mat &frame, int frame_index,
+                   double time_ms = std::numeric_limits<double>::quiet_NaN());
+
+    // first row of the data window for a frame
+    int windowStart(int frame_index, double time_ms) const;
+
+private:
+    // window of series i, at most about two points per plot pixel column
+    bool isIdentity(cv::Size source_size) const;
+    void warp(const cv::Mat &source, cv::Mat &output);
+    // window of series i, at most about two points per plot pixel column
+    GraphData::Span seriesWindow(size_t i, cv::Size size, int first, int last);
+    GraphData::Span liveWindow(size_t i, cv::Size size);
+    // of the live samples or the graph data, whichever is drawn
+    int columnCount() const;
+    // extremes of the keys or the values of the series in the window
+    bool keyRange(int first, int last, double &min, double &max) const;
+    bool valueRange(int first, int last, double &min, double &max) const;
+    // the limits to draw this frame with, fixed or from the window
+    void updateLimits(int first, int last);
+    // m_spans drawn over a copy of the cached axes layer of the limits
+    void renderPlot(cv::Size size);
+
+    CompositorSettings m_settings;
+    std::shared_ptr<const GraphData> m_data;
+    std::shared_ptr<const LiveSource> m_live;
+
+    cv::Mat m_warped;
+    // remap tables of the current rotated warp, shared by compositors
+    // with the same geometry
+    std::shared_ptr<const WarpMaps> m_warp_maps;
+    cv::Mat3b m_axes_layer;
+    cv::Vec4d m_axes_layer_limits;
+    // x and y limits of the frame being drawn; 0 to 1 until an autoscaled
+    // window had numbers
+    double m_x_min = std::numeric_limits<double>::quiet_NaN();
+    double m_x_max = std::numeric_limits<double>::quiet_NaN();
+    double m_y_min = std::numeric_limits<double>::quiet_NaN();
+    double m_y_max = std::numeric_limits<double>::quiet_NaN();
+    cv::Mat3b m_graph;
+    // m_graph premultiplied for OverlayBlend
+    cv::Mat m_overlay_color;
+    cv::Mat m_overlay_inverse_alpha;
+    // window of every series for the frame being drawn; decimated ones
+    // point into the buffers of their series, reused between frames
+    std::vector<GraphData::Span> m_spans;
+    std::vector<std::vector<double>> m_keys;
+    std::vector<std::vector<double>> m_values;
+    PolylineRenderer m_renderer;
+    // newest live rows, column-major, copied out of the ring each frame
+    std::vector<double> m_live_samples;
+    int m_live_count = 0;
+    int m_live_columns = 0;
+    MinMaxPyramid m_live_pyramid;
+};
+
+#endif // FRAMECOMPOSITOR_H
@@ -0,0 +1,35 @@
+#include "frameitem.h"
+
+#include <QPainter>
+
+FrameItem::FrameItem(QGraphicsItem *parent)
+    : QGraphicsItem(parent)
+{
+}
+
+void FrameItem::setFrame(const cv::Mat &frame)
+{
+    Q_ASSERT(frame.empty() || frame.type() == CV_8UC4);
+    if(frame.cols != m_frame.cols || frame.rows != m_frame.rows) {
+        prepareGeometryChange();
+    }
+    m_frame = frame;
+    m_image = frame.empty()
+            ? QImage()
+            : QImage(frame.data, frame.cols, frame.rows, static_cast<int>(frame.step), QImage::Format_RGB32);
+    update();
+}
+
+QRectF FrameItem::boundingRect() const
+{
+    return QRectF(0, 0, m_frame.cols, m_frame.rows);
+}
+
+void FrameItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(option)
+    Q_UNUSED(widget)
+    if(!m_image.isNull()) {
+        painter->drawImage(0, 0, m_image);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef FRAMEITEM_H
+#define FRAMEITEM_H
+
+#include <QGraphicsItem>
+#include <QImage>
+#include <opencv2/core.hpp>
+
+// Paints a BGRX cv::Mat straight from its memory. The item keeps a
+// reference to the Mat and a QImage header over the same pixels, so
+// showing a frame neither converts nor uploads a QPixmap. Hand it a
+// different buffer than the one being written next.
+class FrameItem : public QGraphicsItem
+{
+public:
+    explicit FrameItem(QGraphicsItem *parent = nullptr);
+
+    // frame must be CV_8UC4 (QImage::Format_RGB32 layout)
+    void setFrame(const cv::Mat &frame);
+    const cv::Mat& frame() const { return m_frame; }
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    cv::Mat m_frame;
+    QImage m_image;
+};
+
+#endif // FRAMEITEM_H
@@ -0,0 +1,287 @@
+#include "framepipeline.h"
+#include "stagetimings.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+FramePipeline::FramePipeline()
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+    stop();
+}
+
+void FramePipeline::setSettings(const CompositorSettings &settings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_settings = settings;
+    ++m_settings_version;
+}
+
+void FramePipeline::setGraphData(const std::shared_ptr<const GraphData> &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_data = data;
+    ++m_settings_version;
+}
+
+void FramePipeline::setLiveSource(const std::shared_ptr<const LiveSource> &live)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_live = live;
+    ++m_settings_version;
+}
+
+void FramePipeline::setWriter(VideoEncoder *encoder)
+{
+    std::lock_guard<std::mutex> lock(m_writer_mutex);
+    m_writer = encoder;
+}
+
+void FramePipeline::setLoop(bool loop)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_loop = loop;
+}
+
+void FramePipeline::setDisplayEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_display = enabled;
+}
+
+bool FramePipeline::start(VideoSource *source, int first_frame, int workers, int capacity)
+{
+    stop();
+    if(!source || !source->isOpened()) {
+        return false;
+    }
+
+    if(workers <= 0) {
+        // leave a core each for the decoder and the encoder
+        workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 2);
+    }
+    if(capacity <= 0) {
+        capacity = 2*workers + 2;
+    }
+
+    m_source = source;
+    m_slots.assign(capacity, Slot());
+    m_next_frame_index = first_frame;
+    m_next_decode = 0;
+    m_next_compose = 0;
+    m_next_encode = 0;
+    m_next_display = 0;
+    m_end_sequence = -1;
+    m_stop = false;
+    m_stats = Stats();
+    m_stats.capacity = capacity;
+    m_running = true;
+
+    m_decoder = std::thread(&FramePipeline::decodeLoop, this);
+    for(int i = 0; i < workers; ++i) {
+        m_workers.push_back(std::thread(&FramePipeline::composeLoop, this));
+    }
+    m_encoder = std::thread(&FramePipeline::encodeLoop, this);
+    return true;
+}
+
+void FramePipeline::stop()
+{
+    if(!m_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    wait();
+}
+
+void FramePipeline::wait()
+{
+    if(!m_running) {
+        return;
+    }
+    m_decoder.join();
+    for(std::thread &worker : m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+    m_encoder.join();
+    m_source = nullptr;
+    m_running = false;
+}
+
+bool FramePipeline::isFinished() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_end_sequence >= 0 && m_next_encode >= m_end_sequence;
+}
+
+bool FramePipeline::takeFrame(cv::Mat &frame, int &frame_index)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(!m_running || m_slots.empty()) {
+        return false;
+    }
+    Slot &slot = slotFor(m_next_display);
+    if(slot.state != SlotComposed || slot.sequence != m_next_display) {
+        ++m_stats.output_misses;
+        return false;
+    }
+    lock.unlock();
+
+    // the slot stays ours until it is marked displayed; its display
+    // buffer is traded for the caller's, so nothing is copied
+    cv::swap(slot.display, frame);
+    frame_index = slot.frame_index;
+
+    lock.lock();
+    slot.state = SlotDisplayed;
+    ++m_next_display;
+    lock.unlock();
+    m_changed.notify_all();
+    return true;
+}
+
+FramePipeline::Stats FramePipeline::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    for(const Slot &slot : m_slots) {
+        if(slot.state != SlotFree) {
+            ++stats.in_flight;
+        }
+        if(slot.state == SlotComposed) {
+            ++stats.ready;
+        }
+    }
+    return stats;
+}
+
+void FramePipeline::decodeLoop()
+{
+    while(true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Slot &slot = slotFor(m_next_decode);
+        if(slot.state != SlotFree && !m_stop) {
+            // downstream is behind: this is where backpressure shows up
+            ++m_stats.decoder_stalls;
+            m_changed.wait(lock, [&]{ return m_stop || slot.state == SlotFree; });
+        }
+        if(m_stop) {
+            return;
+        }
+        slot.state = SlotDecoding;
+        long long sequence = m_next_decode;
+        bool loop = m_loop;
+        lock.unlock();
+
+        // looped clips come from the frame cache once it holds them
+        bool ok = m_source->read(m_next_frame_index, slot.decoded, &slot.time_ms);
+        if(!ok && loop) {
+            m_next_frame_index = 0;
+            ok = m_source->read(m_next_frame_index, slot.decoded, &slot.time_ms);
+        }
+
+        lock.lock();
+        if(!ok) {
+            slot.state = SlotFree;
+            m_end_sequence = sequence;
+            lock.unlock();
+            m_changed.notify_all();
+            return;
+        }
+        slot.sequence = sequence;
+        slot.frame_index = m_next_frame_index++;
+        slot.state = SlotDecoded;
+        ++m_next_decode;
+        ++m_stats.decoded;
+        lock.unlock();
+        m_changed.notify_all();
+    }
+}
+
+void FramePipeline::composeLoop()
+{
+    // each worker has its own compositor so render state is never shared
+    FrameCompositor compositor;
+    int settings_version = -1;
+
+    while(true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]{
+            return m_stop || m_next_compose < m_next_decode
+                    || (m_end_sequence >= 0 && m_next_compose >= m_end_sequence);
+        });
+        if(m_stop || m_next_compose >= m_next_decode) {
+            return;
+        }
+        Slot &slot = slotFor(m_next_compose++);
+        slot.state = SlotComposing;
+        if(settings_version != m_settings_version) {
+            compositor.setSettings(m_settings);
+            compositor.setGraphData(m_data);
+            compositor.setLiveSource(m_live);
+            settings_version = m_settings_version;
+        }
+        bool display = m_display;
+        lock.unlock();
+
+        compositor.transform(slot.decoded, slot.frame);
+        compositor.blend(slot.frame, slot.frame_index, slot.time_ms);
+        if(display) {
+            // laid out like QImage::Format_RGB32, converted here rather
+            // than on the UI thread
+            StageTimings::Scope timing(StageTimings::Convert, slot.frame_index);
+            cv::cvtColor(slot.frame, slot.display, cv::COLOR_BGR2BGRA);
+        }
+
+        lock.lock();
+        slot.state = SlotComposed;
+        lock.unlock();
+        m_changed.notify_all();
+    }
+}
+
+void FramePipeline::encodeLoop()
+{
+    while(true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Slot *slot = nullptr;
+        m_changed.wait(lock, [&]{
+            slot = &slotFor(m_next_encode);
+            bool ready = slot->sequence == m_next_encode
+                    && slot->state == (m_display ? SlotDisplayed : SlotComposed);
+            // frames already shown are still written after a stop
+            return ready || m_stop
+                    || (m_end_sequence >= 0 && m_next_encode >= m_end_sequence);
+        });
+        bool ready = slot->sequence == m_next_encode
+                && slot->state == (m_display ? SlotDisplayed : SlotComposed);
+        if(!ready) {
+            return;
+        }
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> writer_lock(m_writer_mutex);
+            if(m_writer && m_writer->isOpened()) {
+                // the slot gets a spare buffer back to decode into
+                m_writer->push(slot->frame, slot->frame_index);
+            }
+        }
+
+        lock.lock();
+        slot->state = SlotFree;
+        ++m_next_encode;
+        ++m_stats.encoded;
+        lock.unlock();
+        m_changed.notify_all();
+    }
+}
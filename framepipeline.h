@@ -0,0 +1,129 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framecompositor.h"
+#include "videoencoder.h"
+#include "videosource.h"
+
+// decode -> composite -> (display) -> encode on separate threads.
+// Frames live in a fixed ring of reused cv::Mat slots; a frame's sequence
+// number picks its slot, so every stage sees frames in decode order and
+// the decoder blocks once the ring is full.
+class FramePipeline
+{
+public:
+    struct Stats
+    {
+        int capacity = 0;
+        int in_flight = 0;          // slots holding a frame
+        int ready = 0;              // composited frames waiting for output
+        long long decoded = 0;
+        long long encoded = 0;
+        long long decoder_stalls = 0;  // decoder waited for a free slot
+        long long output_misses = 0;   // takeFrame found nothing ready
+    };
+
+    FramePipeline();
+    ~FramePipeline();
+
+    // settings and graph data may change while running; workers pick up
+    // the new values with the next frame they composite
+    void setSettings(const CompositorSettings &settings);
+    void setGraphData(const std::shared_ptr<const GraphData> &data);
+    void setLiveSource(const std::shared_ptr<const LiveSource> &live);
+
+    // composited frames are handed to encoder without copying; pass
+    // nullptr before reopening or closing it
+    void setWriter(VideoEncoder *encoder);
+
+    // restart from frame 0 when the capture runs out
+    void setLoop(bool loop);
+
+    // when enabled each frame has to be taken with takeFrame before it
+    // is encoded, which paces the pipeline to the display
+    void setDisplayEnabled(bool enabled);
+
+    // the source must not be read from until stop() or wait() returns;
+    // decoding starts at first_frame
+    bool start(VideoSource *source, int first_frame, int workers = 0, int capacity = 0);
+    void stop();
+    // block until every frame has been encoded
+    void wait();
+
+    bool isRunning() const { return m_running; }
+    bool isFinished() const;
+
+    // the next composited frame as BGRX (QImage::Format_RGB32 layout) if
+    // one is ready; never blocks. frame is swapped with the pipeline's
+    // buffer, so keep two and alternate to show one while taking the next.
+    bool takeFrame(cv::Mat &frame, int &frame_index);
+
+    Stats stats() const;
+
+private:
+    enum SlotState {
+        SlotFree,
+        SlotDecoding,
+        SlotDecoded,
+        SlotComposing,
+        SlotComposed,
+        SlotDisplayed
+    };
+
+    struct Slot
+    {
+        cv::Mat decoded;    // at the source size
+        cv::Mat frame;      // at the output size
+        cv::Mat display;    // BGRX copy of frame when display is enabled
+        int frame_index = 0;
+        double time_ms = 0.0;
+        long long sequence = -1;
+        SlotState state = SlotFree;
+    };
+
+    void decodeLoop();
+    void composeLoop();
+    void encodeLoop();
+
+    Slot& slotFor(long long sequence) { return m_slots[sequence % m_slots.size()]; }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<Slot> m_slots;
+
+    VideoSource *m_source = nullptr;
+    int m_next_frame_index = 0;
+    long long m_next_decode = 0;
+    long long m_next_compose = 0;
+    long long m_next_encode = 0;
+    long long m_next_display = 0;
+    long long m_end_sequence = -1;  // set once the decoder runs out
+    bool m_stop = false;
+    bool m_running = false;
+    bool m_loop = false;
+    bool m_display = false;
+
+    CompositorSettings m_settings;
+    std::shared_ptr<const GraphData> m_data;
+    std::shared_ptr<const LiveSource> m_live;
+    int m_settings_version = 0;
+
+    std::mutex m_writer_mutex;
+    VideoEncoder *m_writer = nullptr;
+
+    Stats m_stats;
+
+    std::thread m_decoder;
+    std::vector<std::thread> m_workers;
+    std::thread m_encoder;
+};
+
+#endif // FRAMEPIPELINE_H
@@ -0,0 +1,317 @@
+#include "graphdata.h"
+
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const char cache_magic[8] = {'C','M','P','C','O','L','S','\0'};
+// 4: min/max pyramids of every column after the columns
+// 5: key order flags
+const quint32 cache_version = 5;
+const quint32 flag_first_line_is_row = 0x1;
+// keys of rows 1..n ascend without NaN
+const quint32 flag_keys_sorted = 0x2;
+// the key of row 0 is a number not above that of row 1
+const quint32 flag_first_key_sorted = 0x4;
+
+// native byte order: the cache only ever lives next to its CSV
+struct CacheHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 flags;
+    qint64 row_count;
+    quint32 column_count;
+    quint32 header_count;   // column names, each a quint32 size and utf-8 bytes
+    qint64 malformed_rows;
+    qint64 csv_size;
+    qint64 csv_modified;    // ms since epoch
+    qint64 data_offset;     // columns, one after another, then their pyramids
+};
+
+qint64 alignTo8(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+
+}
+
+GraphData::GraphData()
+{
+}
+
+GraphData::~GraphData()
+{
+    if(m_map) {
+        m_cache.unmap(m_map);
+    }
+}
+
+QString GraphData::cacheFileName(const QString &file_name)
+{
+    return file_name + ".colcache";
+}
+
+QString GraphData::columnName(int c) const
+{
+    if(m_has_headers && c < m_header.length() && !m_header.at(c).isEmpty()) {
+        return m_header.at(c);
+    }
+    return QString("column %1").arg(c + 1);
+}
+
+std::shared_ptr<GraphData> GraphData::load(const QString &file_name, bool has_headers,
+                                           const CsvParser::ProgressCallback &progress)
+{
+    std::shared_ptr<GraphData> data(new GraphData());
+    if(!data->mapCache(file_name)) {
+        if(!data->parseCsv(file_name, progress)) {
+            return nullptr;
+        }
+        data->buildPyramids();
+        data->findKeyOrder();
+        // serve this load from the mapping as well so the parsed copy and
+        // the built pyramids can go
+        if(data->writeCache(file_name) && data->mapCache(file_name)) {
+            std::vector<double>().swap(data->m_parsed);
+        }
+        else {
+            qDebug() << "unable to write column cache for" << file_name;
+        }
+    }
+    data->selectRows(has_headers);
+    return data;
+}
+
+bool GraphData::parseCsv(const QString &file_name, const CsvParser::ProgressCallback &progress)
+{
+    CsvParser parser;
+    parser.setProgressCallback(progress);
+    CsvParser::Result result = parser.parseFile(file_name);
+    if(!result.ok) {
+        return false;
+    }
+
+    // keep the header candidate as text and as a row
+    m_parsed.swap(result.data);
+    m_header = result.header;
+    m_first_line_is_row = result.first_line_is_row;
+    m_malformed_rows = result.malformed_rows;
+
+    m_column_count = result.column_count;
+    m_all_count = static_cast<int>(result.row_count);
+    m_columns.clear();
+    for(int c = 0; c < m_column_count; ++c) {
+        m_columns.push_back(m_parsed.data() + qint64(c)*m_all_count);
+    }
+    return true;
+}
+
+bool GraphData::writeCache(const QString &file_name) const
+{
+    QFileInfo csv_info(file_name);
+    QByteArray names;
+    foreach(const QString &name, m_header) {
+        QByteArray utf8 = name.toUtf8();
+        quint32 size = utf8.size();
+        names.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        names.append(utf8);
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.flags = (m_first_line_is_row ? flag_first_line_is_row : 0)
+            | (m_keys_sorted_after_first ? flag_keys_sorted : 0)
+            | (m_first_key_sorted ? flag_first_key_sorted : 0);
+    header.row_count = m_all_count;
+    header.column_count = m_column_count;
+    header.header_count = m_header.length();
+    header.malformed_rows = m_malformed_rows;
+    header.csv_size = csv_info.size();
+    header.csv_modified = csv_info.lastModified().toMSecsSinceEpoch();
+    header.data_offset = alignTo8(sizeof(CacheHeader) + names.size());
+
+    QSaveFile cache(cacheFileName(file_name));
+    if(!cache.open(QFile::WriteOnly)) {
+        return false;
+    }
+    qint64 column_bytes = qint64(m_all_count)*sizeof(double);
+    QByteArray padding(header.data_offset - sizeof(CacheHeader) - names.size(), '\0');
+    cache.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+    cache.write(names);
+    cache.write(padding);
+    for(int c = 0; c < m_column_count; ++c) {
+        cache.write(reinterpret_cast<const char*>(m_columns[c]), column_bytes);
+    }
+    qint64 pyramid_bytes = qint64(MinMaxPyramid::storageSize(m_all_count))*sizeof(int);
+    for(int c = 0; c < m_column_count; ++c) {
+        cache.write(reinterpret_cast<const char*>(m_pyramids[c].storage()), pyramid_bytes);
+    }
+    return cache.commit();
+}
+
+bool GraphData::mapCache(const QString &file_name)
+{
+    QFileInfo csv_info(file_name);
+    m_cache.setFileName(cacheFileName(file_name));
+    if(!m_cache.open(QFile::ReadOnly)) {
+        return false;
+    }
+    qint64 size = m_cache.size();
+    if(size < qint64(sizeof(CacheHeader))) {
+        m_cache.close();
+        return false;
+    }
+    uchar *map = m_cache.map(0, size);
+    if(!map) {
+        m_cache.close();
+        return false;
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, map, sizeof(CacheHeader));
+    qint64 column_bytes = header.row_count*qint64(sizeof(double));
+    bool valid = std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0
+            && header.version == cache_version
+            && header.csv_size == csv_info.size()
+            && header.csv_modified == csv_info.lastModified().toMSecsSinceEpoch()
+            && header.column_count >= 2
+            && header.row_count >= 0 && header.row_count <= std::numeric_limits<int>::max()
+            && header.data_offset % sizeof(double) == 0;
+    qint64 pyramid_bytes = valid ? qint64(MinMaxPyramid::storageSize(static_cast<int>(header.row_count)))*sizeof(int) : 0;
+    valid = valid && header.data_offset + header.column_count*(column_bytes + pyramid_bytes) == size;
+
+    QStringList names;
+    const uchar *pos = map + sizeof(CacheHeader);
+    for(quint32 i = 0; valid && i < header.header_count; ++i) {
+        quint32 name_size = 0;
+        valid = pos + sizeof(name_size) <= map + header.data_offset;
+        if(valid) {
+            std::memcpy(&name_size, pos, sizeof(name_size));
+            pos += sizeof(name_size);
+            valid = pos + name_size <= map + header.data_offset;
+        }
+        if(valid) {
+            names << QString::fromUtf8(reinterpret_cast<const char*>(pos), name_size);
+            pos += name_size;
+        }
+    }
+    if(!valid) {
+        // stale or foreign cache: reparse the CSV
+        m_cache.unmap(map);
+        m_cache.close();
+        return false;
+    }
+
+    m_header = names;
+    m_first_line_is_row = header.flags & flag_first_line_is_row;
+    m_keys_sorted_after_first = header.flags & flag_keys_sorted;
+    m_first_key_sorted = header.flags & flag_first_key_sorted;
+    m_malformed_rows = header.malformed_rows;
+
+    m_map = map;
+    m_column_count = header.column_count;
+    m_all_count = static_cast<int>(header.row_count);
+    m_columns.clear();
+    const double *columns = reinterpret_cast<const double*>(map + header.data_offset);
+    for(int c = 0; c < m_column_count; ++c) {
+        m_columns.push_back(columns + c*header.row_count);
+    }
+    // pyramids follow the columns, 8-byte aligned like them
+    const int *pyramids = reinterpret_cast<const int*>(columns + m_column_count*header.row_count);
+    m_pyramids.resize(m_column_count);
+    for(int c = 0; c < m_column_count; ++c) {
+        m_pyramids[c].attach(m_columns[c], m_all_count, pyramids + c*(pyramid_bytes/sizeof(int)));
+    }
+    return true;
+}
+
+void GraphData::selectRows(bool has_headers)
+{
+    m_has_headers = has_headers;
+    m_first_row = has_headers && m_first_line_is_row ? 1 : 0;
+    m_count = m_all_count - m_first_row;
+    m_keys_sorted = m_keys_sorted_after_first && (m_first_row == 1 || m_first_key_sorted);
+    if(!m_keys_sorted) {
+        qDebug() << "keys are not ascending; timestamp alignment falls back to the row rate";
+    }
+}
+
+// over all rows, so they do not depend on has_headers and can be cached
+void GraphData::buildPyramids()
+{
+    m_pyramids.clear();
+    m_pyramids.resize(m_column_count);
+    for(int c = 0; c < m_column_count; ++c) {
+        m_pyramids[c].build(m_columns[c], m_all_count);
+    }
+}
+
+bool GraphData::range(int c, int first, int last, double &min, double &max) const
+{
+    first = std::max(first, 0);
+    last = std::min(last, m_count);
+    if(c < 0 || c >= m_column_count || last <= first) {
+        return false;
+    }
+    // sorted keys have their extremes at the window ends
+    if(c == 0 && m_keys_sorted) {
+        min = keys()[first];
+        max = keys()[last - 1];
+        return true;
+    }
+    return m_pyramids[c].range(first + m_first_row, last + m_first_row, min, max);
+}
+
+GraphData::Span GraphData::window(int c, int first, int last, int max_points,
+                                  std::vector<double> &keys_buffer, std::vector<double> &values_buffer) const
+{
+    Span span;
+    first = std::max(first, 0);
+    last = std::min(last, m_count);
+    if(last <= first) {
+        return span;
+    }
+    if(last - first <= max_points) {
+        span.keys = keys() + first;
+        span.values = column(c) + first;
+        span.count = last - first;
+        return span;
+    }
+    m_pyramids[c].decimate(m_columns[0], first + m_first_row, last + m_first_row, max_points,
+                           keys_buffer, values_buffer);
+    span.keys = keys_buffer.data();
+    span.values = values_buffer.data();
+    span.count = static_cast<int>(keys_buffer.size());
+    return span;
+}
+
+// over all rows, the header line apart, so selectRows can decide either way
+void GraphData::findKeyOrder()
+{
+    m_keys_sorted_after_first = false;
+    m_first_key_sorted = false;
+    if(m_columns.empty()) {
+        return;
+    }
+    const double *k = m_columns[0];
+    m_keys_sorted_after_first = true;
+    for(int i = 1; i < m_all_count && m_keys_sorted_after_first; ++i) {
+        m_keys_sorted_after_first = !std::isnan(k[i]) && (i == 1 || k[i - 1] <= k[i]);
+    }
+    m_first_key_sorted = m_all_count == 0 || (!std::isnan(k[0]) && (m_all_count == 1 || k[0] <= k[1]));
+}
+
+int GraphData::rowAtKey(double key) const
+{
+    const double *k = keys();
+    return static_cast<int>(std::lower_bound(k, k + m_count, key) - k);
+}
@@ -0,0 +1,115 @@
+#ifndef GRAPHDATA_H
+#define GRAPHDATA_H
+
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+#include "csvparser.h"
+#include "minmaxpyramid.h"
+
+// Columns of samples loaded from a CSV file, shared read-only between the
+// UI and the frame compositor. Column 0 holds the keys (x), every other
+// column is a series that can be drawn against them.
+//
+// The first import writes a binary column cache next to the CSV
+// (<file>.colcache); later loads memory-map it, so column() points
+// straight into the mapping and reloads cost no parsing. Every column
+// also gets a min/max pyramid so wide windows can be drawn with about as
+// many points as the plot has pixel columns, and autoscaled without
+// scanning them. The pyramids are stored in the cache as well, so
+// reloads, including the header toggle, map them instead of building.
+class GraphData
+{
+public:
+    // non-owning view of count points; valid while the GraphData and the
+    // buffers passed to window() are
+    struct Span
+    {
+        const double *keys = nullptr;
+        const double *values = nullptr;
+        int count = 0;
+    };
+
+    ~GraphData();
+
+    // load file_name, using or refreshing its column cache; the first
+    // line holds column names if has_headers is set. Returns nullptr if
+    // the CSV cannot be read.
+    static std::shared_ptr<GraphData> load(const QString &file_name, bool has_headers,
+                                           const CsvParser::ProgressCallback &progress = CsvParser::ProgressCallback());
+
+    int count() const { return m_count; }
+    int columnCount() const { return m_column_count; }
+    const double* column(int c) const { return m_columns[c] + m_first_row; }
+    const double* keys() const { return column(0); }
+    const double* values() const { return column(1); }
+
+    // header text, or "column n" without headers
+    QString columnName(int c) const;
+    QString xLabel() const { return m_has_headers ? m_header.value(0) : QString(); }
+    QString yLabel() const { return m_has_headers ? m_header.value(1) : QString(); }
+
+    // rows [first, last) of column c against the keys. Windows of up to
+    // max_points rows point straight into the columns; wider ones are
+    // decimated into the buffers, which keep their capacity between calls.
+    Span window(int c, int first, int last, int max_points,
+                std::vector<double> &keys_buffer, std::vector<double> &values_buffer) const;
+
+    // smallest and largest number of column c in rows [first, last), the
+    // keys included, in O(log n); false if there is none
+    bool range(int c, int first, int last, double &min, double &max) const;
+
+    // keys ascending without NaN, so rows can be found by key
+    bool keysSorted() const { return m_keys_sorted; }
+    // first row whose key is not less than key, count() if none; O(log n)
+    int rowAtKey(double key) const;
+
+    bool isMapped() const { return m_map != nullptr; }
+    // rows the parser could not read as numbers for every column
+    qint64 malformedRows() const { return m_malformed_rows; }
+
+    static QString cacheFileName(const QString &file_name);
+
+private:
+    GraphData();
+    GraphData(const GraphData&) = delete;
+    GraphData& operator=(const GraphData&) = delete;
+
+    bool parseCsv(const QString &file_name, const CsvParser::ProgressCallback &progress);
+    bool writeCache(const QString &file_name) const;
+    bool mapCache(const QString &file_name);
+    void selectRows(bool has_headers);
+    void buildPyramids();
+    void findKeyOrder();
+
+    // all parsed rows, column-major; the first may be the header line read as numbers
+    std::vector<double> m_parsed;
+    bool m_first_line_is_row = false;
+    qint64 m_malformed_rows = 0;
+    QStringList m_header;
+
+    QFile m_cache;
+    uchar *m_map = nullptr;
+
+    std::vector<const double*> m_columns;
+    int m_column_count = 0;
+    int m_all_count = 0;
+
+    int m_first_row = 0;
+    int m_count = 0;
+    bool m_has_headers = false;
+
+    // one per column over all rows, the header line included; queries
+    // are offset by m_first_row. Built on import, then mapped.
+    std::vector<MinMaxPyramid> m_pyramids;
+    // key order over rows 1..n and of row 0 against row 1, found on
+    // import and cached; m_keys_sorted is for the selected rows
+    bool m_keys_sorted_after_first = false;
+    bool m_first_key_sorted = false;
+    bool m_keys_sorted = false;
+};
+
+#endif // GRAPHDATA_H
@@ -0,0 +1,227 @@
+#include "keyframeindex.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// raw packets and their keyframe flag
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+#define KEYFRAMEINDEX_RAW_PACKETS
+#endif
+
+namespace {
+
+const char index_magic[8] = {'C','M','P','K','E','Y','S','\0'};
+// 2: presentation times sorted after a raw packet scan
+const quint32 index_version = 2;
+const quint32 flag_has_keyframes = 0x1;
+
+// native byte order, like the column cache
+struct IndexHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 flags;
+    qint64 video_size;
+    qint64 video_modified;  // ms since epoch
+    qint64 frame_count;     // timestamps, one double per frame
+    qint64 keyframe_count;  // keyframes, one qint32 each, after the timestamps
+};
+
+}
+
+KeyframeIndex::KeyframeIndex()
+    : m_cancel(false)
+{
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+    close();
+}
+
+QString KeyframeIndex::indexFileName(const QString &video_file)
+{
+    return video_file + ".keyindex";
+}
+
+void KeyframeIndex::open(const QString &video_file)
+{
+    close();
+    if(loadFile(video_file)) {
+        return;
+    }
+    m_cancel = false;
+    m_thread = std::thread(&KeyframeIndex::build, this, video_file);
+}
+
+void KeyframeIndex::close()
+{
+    m_cancel = true;
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ready = false;
+    m_has_keyframes = false;
+    m_keyframes.clear();
+    m_timestamps.clear();
+}
+
+void KeyframeIndex::wait()
+{
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool KeyframeIndex::isReady() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ready;
+}
+
+bool KeyframeIndex::hasKeyframes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_has_keyframes;
+}
+
+int KeyframeIndex::frameCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ready ? static_cast<int>(m_timestamps.size()) : -1;
+}
+
+int KeyframeIndex::keyframeBefore(int frame) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_has_keyframes || frame < 0) {
+        return -1;
+    }
+    auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), frame);
+    return it == m_keyframes.begin() ? -1 : *(it - 1);
+}
+
+double KeyframeIndex::timestamp(int frame) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(frame < 0 || frame >= static_cast<int>(m_timestamps.size())) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return m_timestamps[frame];
+}
+
+void KeyframeIndex::build(const QString &video_file)
+{
+    std::string file_name = video_file.toStdString();
+    cv::VideoCapture capture;
+    bool raw = false;
+#ifdef KEYFRAMEINDEX_RAW_PACKETS
+    raw = capture.open(file_name, cv::CAP_FFMPEG, {cv::CAP_PROP_FORMAT, -1});
+#endif
+    if(!raw && !capture.open(file_name)) {
+        qDebug() << "unable to index" << video_file;
+        return;
+    }
+
+    std::vector<int> keyframes;
+    std::vector<double> timestamps;
+    while(!m_cancel && capture.grab()) {
+#ifdef KEYFRAMEINDEX_RAW_PACKETS
+        if(raw && capture.get(cv::CAP_PROP_LRF_HAS_KEY_FRAME) != 0) {
+            keyframes.push_back(static_cast<int>(timestamps.size()));
+        }
+#endif
+        timestamps.push_back(capture.get(cv::CAP_PROP_POS_MSEC));
+    }
+    if(m_cancel) {
+        return;
+    }
+    if(raw) {
+        // packets come in decode order, so with B-frames their PTS jump
+        // back and forth; presentation order is ascending PTS
+        std::sort(timestamps.begin(), timestamps.end());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_keyframes.swap(keyframes);
+        m_timestamps.swap(timestamps);
+        // a stream always starts with a keyframe; none means no flags
+        m_has_keyframes = raw && !m_keyframes.empty();
+        m_ready = true;
+    }
+    if(!saveFile(video_file)) {
+        qDebug() << "unable to write keyframe index for" << video_file;
+    }
+}
+
+bool KeyframeIndex::saveFile(const QString &video_file) const
+{
+    QFileInfo video_info(video_file);
+    IndexHeader header;
+    std::memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = index_version;
+    header.flags = m_has_keyframes ? flag_has_keyframes : 0;
+    header.video_size = video_info.size();
+    header.video_modified = video_info.lastModified().toMSecsSinceEpoch();
+    header.frame_count = m_timestamps.size();
+    header.keyframe_count = m_keyframes.size();
+
+    QSaveFile file(indexFileName(video_file));
+    if(!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    std::vector<qint32> keyframes(m_keyframes.begin(), m_keyframes.end());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+    file.write(reinterpret_cast<const char*>(m_timestamps.data()), m_timestamps.size()*sizeof(double));
+    file.write(reinterpret_cast<const char*>(keyframes.data()), keyframes.size()*sizeof(qint32));
+    return file.commit();
+}
+
+bool KeyframeIndex::loadFile(const QString &video_file)
+{
+    QFileInfo video_info(video_file);
+    QFile file(indexFileName(video_file));
+    if(!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = file.readAll();
+    if(data.size() < static_cast<int>(sizeof(IndexHeader))) {
+        return false;
+    }
+    IndexHeader header;
+    std::memcpy(&header, data.constData(), sizeof(IndexHeader));
+    bool valid = std::memcmp(header.magic, index_magic, sizeof(index_magic)) == 0
+            && header.version == index_version
+            && header.video_size == video_info.size()
+            && header.video_modified == video_info.lastModified().toMSecsSinceEpoch()
+            && header.frame_count >= 0 && header.keyframe_count >= 0
+            && qint64(sizeof(IndexHeader)) + header.frame_count*qint64(sizeof(double))
+               + header.keyframe_count*qint64(sizeof(qint32)) == data.size();
+    if(!valid) {
+        // stale or foreign index: build it again
+        return false;
+    }
+
+    const char *pos = data.constData() + sizeof(IndexHeader);
+    std::vector<double> timestamps(header.frame_count);
+    std::memcpy(timestamps.data(), pos, timestamps.size()*sizeof(double));
+    pos += timestamps.size()*sizeof(double);
+    std::vector<qint32> keyframes(header.keyframe_count);
+    std::memcpy(keyframes.data(), pos, keyframes.size()*sizeof(qint32));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_timestamps.swap(timestamps);
+    m_keyframes.assign(keyframes.begin(), keyframes.end());
+    m_has_keyframes = header.flags & flag_has_keyframes;
+    m_ready = true;
+    return true;
+}
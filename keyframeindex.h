@@ -0,0 +1,54 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+#include <QString>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keyframe positions and timestamps of every frame of a video, built on a
+// background thread when a video is opened and cached next to it
+// (<file>.keyindex). Building only demuxes the stream where OpenCV can
+// report keyframes of raw packets (4.6+); older versions decode every
+// frame and record timestamps only.
+class KeyframeIndex
+{
+public:
+    KeyframeIndex();
+    ~KeyframeIndex();
+
+    // load the cached index or start building it
+    void open(const QString &video_file);
+    // stops a running build
+    void close();
+    // blocks until a running build has finished
+    void wait();
+
+    bool isReady() const;
+    bool hasKeyframes() const;
+    // exact number of frames, -1 until ready
+    int frameCount() const;
+    // the last keyframe at or before frame, -1 if unknown
+    int keyframeBefore(int frame) const;
+    // presentation time of frame in ms, NaN if unknown
+    double timestamp(int frame) const;
+
+    static QString indexFileName(const QString &video_file);
+
+private:
+    void build(const QString &video_file);
+    bool loadFile(const QString &video_file);
+    bool saveFile(const QString &video_file) const;
+
+    mutable std::mutex m_mutex;
+    bool m_ready = false;
+    bool m_has_keyframes = false;
+    std::vector<int> m_keyframes;
+    std::vector<double> m_timestamps;
+
+    std::thread m_thread;
+    std::atomic<bool> m_cancel;
+};
+
+#endif // KEYFRAMEINDEX_H
@@ -0,0 +1,312 @@
+#include "livesource.h"
+#include "csvparser.h"
+
+#include <QFile>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QUrl>
+#include <QDebug>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// a file someone keeps appending to; reads start at the beginning and
+// start over when the file is truncated
+class TailFileSource : public LiveSource
+{
+public:
+    TailFileSource(const QString &file_name, int capacity)
+        : LiveSource(file_name, capacity)
+    {
+    }
+
+    ~TailFileSource()
+    {
+        stop();
+    }
+
+protected:
+    bool openStream() override
+    {
+        m_file.setFileName(address());
+        return m_file.open(QFile::ReadOnly);
+    }
+
+    bool readStream(QByteArray &chunk, int timeout_ms) override
+    {
+        if(m_file.size() < m_file.pos()) {
+            qDebug() << address() << "was truncated, reading it again";
+            m_file.seek(0);
+        }
+        QByteArray data = m_file.read(1 << 20);
+        if(data.isEmpty()) {
+            // nothing new: poll again after a short nap
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+            return true;
+        }
+        chunk.append(data);
+        return true;
+    }
+
+    void closeStream() override
+    {
+        m_file.close();
+    }
+
+private:
+    QFile m_file;
+};
+
+// used blocking on the reader thread, which has no event loop
+template<typename Socket>
+class SocketSource : public LiveSource
+{
+public:
+    SocketSource(const QString &address, int capacity)
+        : LiveSource(address, capacity)
+    {
+    }
+
+    ~SocketSource()
+    {
+        stop();
+    }
+
+protected:
+    void closeStream() override
+    {
+        if(m_socket) {
+            m_socket->abort();
+            m_socket.reset();
+        }
+    }
+
+    bool waitConnected()
+    {
+        if(!m_socket->waitForConnected(3000)) {
+            qWarning() << "unable to connect to" << address() << m_socket->errorString();
+            return false;
+        }
+        return true;
+    }
+
+    bool readStream(QByteArray &chunk, int timeout_ms) override
+    {
+        if(m_socket->bytesAvailable() == 0 && !m_socket->waitForReadyRead(timeout_ms)) {
+            // a timeout just means nothing arrived
+            return m_socket->state() == connectedState();
+        }
+        chunk.append(m_socket->readAll());
+        return true;
+    }
+
+    virtual int connectedState() const = 0;
+
+    std::unique_ptr<Socket> m_socket;
+};
+
+class TcpSource : public SocketSource<QTcpSocket>
+{
+public:
+    TcpSource(const QString &address, const QString &host, quint16 port, int capacity)
+        : SocketSource<QTcpSocket>(address, capacity), m_host(host), m_port(port)
+    {
+    }
+
+protected:
+    bool openStream() override
+    {
+        m_socket.reset(new QTcpSocket());
+        // samples are small and should not wait for more to fill a packet
+        m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        m_socket->connectToHost(m_host, m_port, QIODevice::ReadOnly);
+        return waitConnected();
+    }
+
+    int connectedState() const override
+    {
+        return QAbstractSocket::ConnectedState;
+    }
+
+private:
+    QString m_host;
+    quint16 m_port;
+};
+
+// a UNIX domain socket, or a named pipe on Windows
+class LocalSocketSource : public SocketSource<QLocalSocket>
+{
+public:
+    LocalSocketSource(const QString &address, const QString &path, int capacity)
+        : SocketSource<QLocalSocket>(address, capacity), m_path(path)
+    {
+    }
+
+protected:
+    bool openStream() override
+    {
+        m_socket.reset(new QLocalSocket());
+        m_socket->connectToServer(m_path, QIODevice::ReadOnly);
+        return waitConnected();
+    }
+
+    int connectedState() const override
+    {
+        return QLocalSocket::ConnectedState;
+    }
+
+private:
+    QString m_path;
+};
+
+// how long a read waits for data before checking for stop()
+const int read_timeout_ms = 2;
+
+}
+
+std::shared_ptr<LiveSource> LiveSource::create(const QString &address, int capacity)
+{
+    if(address.startsWith("tcp://")) {
+        QUrl url(address);
+        if(!url.isValid() || url.host().isEmpty() || url.port() <= 0) {
+            qWarning() << "expected tcp://host:port, got" << address;
+            return nullptr;
+        }
+        return std::make_shared<TcpSource>(address, url.host(), static_cast<quint16>(url.port()), capacity);
+    }
+    if(address.startsWith("unix:")) {
+        QString path = address.mid(5);
+        if(path.isEmpty()) {
+            qWarning() << "expected unix:/path/to/socket, got" << address;
+            return nullptr;
+        }
+        return std::make_shared<LocalSocketSource>(address, path, capacity);
+    }
+    if(address.isEmpty()) {
+        return nullptr;
+    }
+    return std::make_shared<TailFileSource>(address, capacity);
+}
+
+LiveSource::LiveSource(const QString &address, int capacity)
+    : m_address(address)
+    , m_capacity(capacity)
+    , m_malformed_rows(0)
+    , m_stop(false)
+    , m_running(false)
+{
+}
+
+LiveSource::~LiveSource()
+{
+    // the reader calls into the derived class, so that one stops it
+    // before it is destroyed; this only catches a thread that never ran
+    stop();
+}
+
+bool LiveSource::start()
+{
+    stop();
+    // a new stream may bring different columns
+    std::atomic_store(&m_ring, std::shared_ptr<SampleRing>());
+    m_header_checked = false;
+    m_stop = false;
+    m_running = true;
+    m_thread = std::thread(&LiveSource::run, this);
+    return true;
+}
+
+void LiveSource::stop()
+{
+    m_stop = true;
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_running = false;
+}
+
+std::shared_ptr<const SampleRing> LiveSource::ring() const
+{
+    return std::atomic_load(&m_ring);
+}
+
+void LiveSource::run()
+{
+    if(!openStream()) {
+        qWarning() << "unable to open live data source" << m_address;
+        m_running = false;
+        return;
+    }
+
+    QByteArray pending;
+    while(!m_stop) {
+        if(!readStream(pending, read_timeout_ms)) {
+            qDebug() << "live data source" << m_address << "ended";
+            break;
+        }
+        // every complete line goes into the ring right away; a partial
+        // last line waits for the rest
+        const char *begin = pending.constData();
+        const char *end = begin + pending.size();
+        const char *line = begin;
+        while(const char *line_end = static_cast<const char*>(std::memchr(line, '\n', end - line))) {
+            parseLine(line, line_end);
+            line = line_end + 1;
+        }
+        pending.remove(0, static_cast<int>(line - begin));
+    }
+    closeStream();
+    m_running = false;
+}
+
+void LiveSource::parseLine(const char *begin, const char *end)
+{
+    // split into fields, NaN for empty or unreadable ones
+    std::vector<double> &row = m_row;
+    row.clear();
+    bool numbers = true;
+    const char *field = begin;
+    while(true) {
+        const char *field_end = static_cast<const char*>(std::memchr(field, ',', end - field));
+        if(!field_end) {
+            field_end = end;
+        }
+        double value = std::numeric_limits<double>::quiet_NaN();
+        if(!CsvParser::parseDouble(field, field_end, &value)) {
+            numbers = false;
+            value = std::numeric_limits<double>::quiet_NaN();
+        }
+        row.push_back(value);
+        if(field_end == end) {
+            break;
+        }
+        field = field_end + 1;
+    }
+
+    bool first_line = !m_header_checked;
+    m_header_checked = true;
+    if(row.size() < 2) {
+        // blank lines between samples are harmless
+        if(end > begin && !(end - begin == 1 && *begin == '\r')) {
+            ++m_malformed_rows;
+        }
+        return;
+    }
+    if(first_line && !numbers) {
+        // column names
+        return;
+    }
+
+    if(!m_ring) {
+        std::shared_ptr<SampleRing> ring = std::make_shared<SampleRing>(static_cast<int>(row.size()), m_capacity);
+        std::atomic_store(&m_ring, ring);
+    }
+    int columns = m_ring->columnCount();
+    if(!numbers || static_cast<int>(row.size()) < columns) {
+        ++m_malformed_rows;
+    }
+    row.resize(columns, std::numeric_limits<double>::quiet_NaN());
+    m_ring->push(row.data());
+}
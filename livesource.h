@@ -0,0 +1,72 @@
+#ifndef LIVESOURCE_H
+#define LIVESOURCE_H
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "samplering.h"
+
+// Samples arriving while the video plays, as "x,y[,y2...]" lines like the
+// CSV files. A reader thread parses every complete line into a SampleRing
+// as soon as it arrives; the compositor copies the newest rows from the
+// ring for each frame without waiting for the reader. A first line that
+// is not numbers is skipped as the header, and the first row decides how
+// many columns are kept.
+//
+// Implementations only move bytes: open the stream, hand out whatever
+// arrived and close it again, all on the reader thread.
+class LiveSource
+{
+public:
+    virtual ~LiveSource();
+
+    // "tcp://host:port", "unix:/path/to/socket" or a file to follow as it
+    // grows; nullptr for an unusable address
+    static std::shared_ptr<LiveSource> create(const QString &address, int capacity = 1 << 20);
+
+    bool start();
+    void stop();
+    // false once the stream has ended or could not be opened
+    bool isRunning() const { return m_running; }
+
+    QString address() const { return m_address; }
+    // nullptr until the first row has arrived
+    std::shared_ptr<const SampleRing> ring() const;
+    long long malformedRows() const { return m_malformed_rows; }
+
+protected:
+    LiveSource(const QString &address, int capacity);
+
+    virtual bool openStream() = 0;
+    // append what arrived within timeout_ms to chunk; false once the
+    // stream has ended
+    virtual bool readStream(QByteArray &chunk, int timeout_ms) = 0;
+    virtual void closeStream() = 0;
+
+    // stop() was called
+    bool isStopping() const { return m_stop; }
+
+private:
+    LiveSource(const LiveSource&) = delete;
+    LiveSource& operator=(const LiveSource&) = delete;
+
+    void run();
+    void parseLine(const char *begin, const char *end);
+
+    QString m_address;
+    int m_capacity;
+    std::shared_ptr<SampleRing> m_ring;
+    bool m_header_checked = false;
+    std::vector<double> m_row;
+    std::atomic<long long> m_malformed_rows;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_running;
+};
+
+#endif // LIVESOURCE_H
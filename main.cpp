@@ -1,9 +1,16 @@
 #include "mainwindow.h"
+#include "batchrenderer.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    // headless render: no QApplication so it runs without a display
+    if(BatchRenderer::isBatchInvocation(argc, argv)) {
+        QCoreApplication a(argc, argv);
+        return BatchRenderer::run(a.arguments());
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -1,17 +1,27 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "frameitem.h"
+#include "timelinewidget.h"
+#include "stagetimings.h"
 
 #include <opencv2/imgproc.hpp>
 #include <QGraphicsScene>
-#include <QGraphicsPixmapItem>
 #include <QStandardPaths>
 #include <QFileDialog>
 #include <QSettings>
 #include <QTimer>
 #include <QElapsedTimer>
-
-#define CVPLOT_HEADER_ONLY
-#include <CvPlot/cvplot.h>
+#include <QColorDialog>
+#include <QListWidget>
+#include <QLabel>
+#include <QGraphicsRectItem>
+#include <QGraphicsSimpleTextItem>
+#include <QFontDatabase>
+#include <QMessageBox>
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QCheckBox>
+#include <QLineEdit>
 
 
 MainWindow::MainWindow(QWidget *parent)
@@ -22,14 +32,80 @@ MainWindow::MainWindow(QWidget *parent)
     m_timer = new QTimer(this);
     connect(m_timer, &QTimer::timeout, this, &MainWindow::onTimerTimeout);
     m_scene = new QGraphicsScene(this);
-    m_pixmap_frame = new QGraphicsPixmapItem();
-    m_scene->addItem(m_pixmap_frame);
+    m_frame_item = new FrameItem();
+    m_scene->addItem(m_frame_item);
+    // the graph rect is shown on its own item above the frame, so
+    // redrawing the graph does not convert the whole frame again
+    m_graph_item = new FrameItem(m_frame_item);
+    m_graph_item->hide();
     ui->graphicsView->setScene(m_scene);
     ui->graphicsView->setBackgroundBrush(QBrush(QColor(Qt::black)));
+
+    // every timed call of a run is kept for the trace export
+    StageTimings::instance().setTraceEnabled(true);
+    m_timing_hud = new QGraphicsRectItem();
+    m_timing_hud->setPen(Qt::NoPen);
+    m_timing_hud->setBrush(QColor(0, 0, 0, 160));
+    m_timing_hud->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+    m_timing_hud->setZValue(1);
+    m_timing_text = new QGraphicsSimpleTextItem(m_timing_hud);
+    m_timing_text->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    m_timing_text->setBrush(Qt::white);
+    m_timing_text->setPos(6, 4);
+    m_scene->addItem(m_timing_hud);
+    m_timing_hud->hide();
+
+    m_cache_label = new QLabel(this);
+    ui->statusbar->addPermanentWidget(m_cache_label);
+    QSettings settings;
+    ui->spinBoxFrameCache->setValue(settings.value("frameCacheMegabytes", ui->spinBoxFrameCache->value()).toInt());
+    m_video.cache().setBudget(ui->spinBoxFrameCache->value()*1024LL*1024);
+    updateCacheLabel();
+
+    // redraws the paused frame as live samples arrive
+    m_live_timer = new QTimer(this);
+    connect(m_live_timer, &QTimer::timeout, this, &MainWindow::onLiveTimerTimeout);
+    ui->lineEditLiveSource->setText(settings.value("liveSource").toString());
+    ui->checkBoxTimingHud->setChecked(settings.value("timingHud", false).toBool());
+
+    // picks up paused frames composited again on the preview thread
+    m_preview_timer = new QTimer(this);
+    m_preview_timer->setInterval(10);
+    connect(m_preview_timer, &QTimer::timeout, this, &MainWindow::onPreviewTimerTimeout);
+
+    ui->comboBoxCodec->addItem("MPEG-4", "mp4");
+    ui->comboBoxCodec->addItem("H.264", "h264");
+    ui->comboBoxCodec->addItem("H.265/HEVC", "hevc");
+    ui->comboBoxCodec->addItem("MJPEG (intermediate)", "avi");
+    ui->comboBoxCodec->addItem("FFV1 (lossless)", "ffv1");
+    ui->comboBoxPreset->addItems(EncoderSettings::presets());
+    setEncoderSettings(EncoderSettings::load(settings));
+
+    for(QSpinBox *box : outputGeometryBoxes()) {
+        connect(box, QOverload<int>::of(&QSpinBox::valueChanged), this, [this]{
+            updateOutputGeometry();
+            requestPreview();
+        });
+    }
+    connectPreviewInputs();
+
+    // scrubbing shows thumbnails; the frame is decoded once on release
+    connect(ui->timeline, &TimelineWidget::frameRequested, this, [this](int frame){
+        if(m_pipeline.isRunning()) {
+            on_pushButtonPause_clicked();
+        }
+        if(m_video.isOpened()) {
+            seekFrame(frame);
+        }
+    });
 }
 
 MainWindow::~MainWindow()
 {
+    m_pipeline.stop();
+    if(m_live) {
+        m_live->stop();
+    }
     delete ui;
 }
 
@@ -43,49 +119,107 @@ void MainWindow::on_pushButtonLoadVideo_clicked()
         return;
     }
     else {
-        ui->lineEditFileName->setText(file_name);
-        if(m_capture.open(file_name.toStdString())) {
-            m_capture.set(cv::CAP_PROP_POS_FRAMES, 0);
-            double total_frames = m_capture.get(cv::CAP_PROP_FRAME_COUNT);
-            ui->spinBoxFrame->setSuffix(QString("/%1").arg(total_frames));
-
-            double frame_w = m_capture.get(cv::CAP_PROP_FRAME_WIDTH);
-            double frame_h = m_capture.get(cv::CAP_PROP_FRAME_HEIGHT);
-
-            double fps = m_capture.get(cv::CAP_PROP_FPS);
-            ui->doubleSpinBoxFpsSet->setSuffix(QString(" (%1 native)").arg(fps));
-            ui->doubleSpinBoxFpsSet->setValue(fps);
-            ui->doubleSpinBoxWriterFps->setValue(fps);
-
-            ui->labelVideoFormat->setText(QString("Video format:%1x%2 px \n%3 FPS")
-                                          .arg(frame_w).arg(frame_h).arg(fps));
-
-            ui->graphicsView->setSceneRect(0,0,frame_w,frame_h);
-
-            ui->spinBoxGraphY->setRange(0,frame_h);
-            ui->spinBoxGraphX->setRange(0,frame_w);
-            ui->spinBoxGraphH->setRange(0,frame_h);
-            ui->spinBoxGraphW->setRange(0,frame_w);
-
-            ui->spinBoxGraphX->setValue(0);
-            ui->spinBoxGraphY->setValue(frame_h/2);
-            ui->spinBoxGraphW->setValue(frame_w);
-            ui->spinBoxGraphH->setValue(frame_h/2);
-
-            m_capture.read(m_source);
-            //m_processed = cv::Mat::zeros( m_source.size(), CV_8UC3 );
-            handleFrame();
-        }
+        openVideo(file_name);
         settings.setValue("lastFileOpenDir", file_name);
     }
 
 }
 
+// a typed camera number or device path opens a live capture
+void MainWindow::on_lineEditFileName_returnPressed()
+{
+    QString file_name = ui->lineEditFileName->text().trimmed();
+    if(!file_name.isEmpty()) {
+        openVideo(file_name);
+    }
+}
+
+void MainWindow::openVideo(const QString &file_name)
+{
+    on_pushButtonPause_clicked();
+    ui->lineEditFileName->setText(file_name);
+    // stopped before the keyframe index it reads is opened again
+    m_thumbnails.close();
+    m_source_size = cv::Size();
+    // the keyframe index for seeking is built in the background
+    if(m_video.open(file_name)) {
+        // nothing of the previous video is drawn again
+        m_preview.cancel();
+        m_source.release();
+        m_source_index = -1;
+        m_frame_index = -1;
+        ui->spinBoxFrame->setSuffix(QString("/%1").arg(m_video.frameCount()));
+        if(!m_video.isDevice()) {
+            m_thumbnails.open(file_name, m_video.index());
+        }
+        ui->timeline->setThumbnails(m_video.isDevice() ? nullptr : &m_thumbnails);
+        ui->timeline->setFrameCount(m_video.frameCount());
+
+        double frame_w = m_video.get(cv::CAP_PROP_FRAME_WIDTH);
+        double frame_h = m_video.get(cv::CAP_PROP_FRAME_HEIGHT);
+        m_source_size = cv::Size(static_cast<int>(frame_w), static_cast<int>(frame_h));
+
+        double fps = videoFps();
+        ui->doubleSpinBoxFpsSet->setSuffix(QString(" (%1 native)").arg(fps));
+        ui->doubleSpinBoxFpsSet->setValue(fps);
+        ui->doubleSpinBoxWriterFps->setValue(fps);
+
+        ui->labelVideoFormat->setText(QString("Video format:%1x%2 px \n%3 FPS")
+                                      .arg(frame_w).arg(frame_h).arg(fps));
+
+        // a crop of the previous video may not fit
+        for(QSpinBox *box : outputGeometryBoxes()) {
+            box->blockSignals(true);
+        }
+        ui->spinBoxCropX->setRange(0,frame_w);
+        ui->spinBoxCropY->setRange(0,frame_h);
+        ui->spinBoxCropW->setRange(0,frame_w);
+        ui->spinBoxCropH->setRange(0,frame_h);
+        for(QSpinBox *box : outputGeometryBoxes()) {
+            box->blockSignals(false);
+        }
+        updateOutputGeometry();
+
+        // graph over the lower half of the output
+        QRect output_rect = ui->graphicsView->sceneRect().toRect();
+        ui->spinBoxGraphX->setValue(0);
+        ui->spinBoxGraphY->setValue(output_rect.height()/2);
+        ui->spinBoxGraphW->setValue(output_rect.width());
+        ui->spinBoxGraphH->setValue(output_rect.height()/2);
+
+        //m_processed = cv::Mat::zeros( m_source.size(), CV_8UC3 );
+        seekFrame(0);
+    }
+}
+
+// cameras often do not report a rate
+double MainWindow::videoFps() const
+{
+    double fps = m_video.get(cv::CAP_PROP_FPS);
+    return fps > 0.0 ? fps : 30.0;
+}
+
 void MainWindow::on_pushButtonPlay_clicked()
 {
-    if(m_capture.isOpened()) {
-        double fps = m_capture.get(cv::CAP_PROP_FPS);
+    if(m_video.isOpened()) {
+        double fps = videoFps();
         int interval = 1000.0/fps;
+
+        // decoding, compositing and encoding run on the pipeline threads;
+        // the timer only picks up finished frames for display
+        m_pipeline.setSettings(compositorSettings());
+        m_pipeline.setGraphData(m_graph);
+        m_pipeline.setLiveSource(m_live);
+        m_pipeline.setLoop(ui->checkBoxLoop->isChecked());
+        m_pipeline.setDisplayEnabled(true);
+        // a preview still being drawn is not shown over the pipeline's
+        // frames, and the frame shown when pausing is decoded again
+        m_preview.cancel();
+        m_source_index = -1;
+        // timings and trace cover one play run
+        StageTimings::instance().reset();
+        // from the frame after the one shown
+        m_pipeline.start(&m_video, m_frame_index + 1);
         m_timer->start(interval);
 
         ui->pushButtonPlay->setEnabled(false);
@@ -95,202 +229,476 @@ void MainWindow::on_pushButtonPlay_clicked()
 
 void MainWindow::on_pushButtonPause_clicked()
 {
-    if(m_capture.isOpened()) {
+    if(m_video.isOpened()) {
         m_timer->stop();
+        if(m_pipeline.isRunning()) {
+            // the decoder read ahead; the next seekFrame positions the
+            // video again
+            m_pipeline.stop();
+        }
 
         ui->pushButtonPlay->setEnabled(true);
         ui->pushButtonPause->setEnabled(false);
     }
 }
 
-void MainWindow::handleFrame()
+CompositorSettings MainWindow::compositorSettings() const
 {
-    if(m_source.empty()) {
-        return;
-    }
-
-    double rotation = ui->doubleSpinBoxRotate->value();
-    if(!qFuzzyIsNull(rotation)) {
-        cv::Point2f center(m_source.cols/2., m_source.rows/2.);          //point from where to rotate
-        double scale = ui->doubleSpinBoxScale->value();
-        cv::Mat r = getRotationMatrix2D(center, rotation, scale);      //Mat object for storing after rotation
-        warpAffine(m_source, m_source, r, cv::Size(m_source.cols, m_source.rows));  ///applie an affine transforation to image.
+    CompositorSettings s;
+    s.rotation = ui->doubleSpinBoxRotate->value();
+    s.scale = ui->doubleSpinBoxScale->value();
+    s.crop = cv::Rect(ui->spinBoxCropX->value(), ui->spinBoxCropY->value(),
+                      ui->spinBoxCropW->value(), ui->spinBoxCropH->value());
+    s.output_size = cv::Size(ui->spinBoxOutputW->value(), ui->spinBoxOutputH->value());
+    s.fps = ui->doubleSpinBoxFpsSet->value();
+
+    s.graph_rect = cv::Rect(ui->spinBoxGraphX->value(), ui->spinBoxGraphY->value(),
+                            ui->spinBoxGraphW->value(), ui->spinBoxGraphH->value());
+    s.alpha = ui->doubleSpinBoxGraphAlpha->value();
+    s.line_weight = ui->spinBoxLineWeight->value();
+
+    s.series.clear();
+    for(int i = 0; i < ui->listWidgetSeries->count(); ++i) {
+        QListWidgetItem *item = ui->listWidgetSeries->item(i);
+        if(item->checkState() == Qt::Checked) {
+            QColor color = item->data(Qt::DecorationRole).value<QColor>();
+            SeriesStyle style;
+            style.column = item->data(Qt::UserRole).toInt();
+            style.color = cv::Scalar(color.blue(), color.green(), color.red());
+            s.series.push_back(style);
+        }
     }
 
-    //qDebug()<<"transformed source dim"<<m_source.cols<<m_source.rows;
+    s.margin_left = ui->spinBoxMarginLeft->value();
+    s.margin_right = ui->spinBoxMarginRight->value();
+    s.margin_top = ui->spinBoxMarginTop->value();
+    s.margin_bottom = ui->spinBoxMarginBottom->value();
+
+    s.x_label = ui->lineEditXLabel->text().toStdString();
+    s.y_label = ui->lineEditYLabel->text().toStdString();
+
+    s.tighten_x = ui->checkBoxTightenX->isChecked();
+    s.tighten_y = ui->checkBoxTightenY->isChecked();
+    s.auto_scale_x = ui->checkBoxAutoScaleX->isChecked();
+    s.auto_scale_y = ui->checkBoxAutoScaleY->isChecked();
+    s.smooth_scale_y = ui->checkBoxSmoothScaleY->isChecked();
+    s.x_min = ui->doubleSpinBoxXMin->value();
+    s.x_max = ui->doubleSpinBoxXMax->value();
+    s.y_min = ui->doubleSpinBoxYMin->value();
+    s.y_max = ui->doubleSpinBoxYMax->value();
+
+    s.x_offset = ui->spinBoxXOffset->value();
+    s.x_rate = ui->spinBoxXRate->value();
+    s.x_window = ui->spinBoxXWindow->value();
+
+    s.align_timestamps = ui->checkBoxAlignTimestamps->isChecked();
+    s.key_offset = ui->doubleSpinBoxKeyOffset->value();
+    s.key_rate = ui->doubleSpinBoxKeyRate->value();
+    s.drift_ppm = ui->doubleSpinBoxDriftPpm->value();
+    return s;
+}
 
-    // get the frame rectangle from the graphics view
-    QRect frame_rect = ui->graphicsView->sceneRect().toRect();
+// every setting of the overlay draws the paused frame again
+void MainWindow::connectPreviewInputs()
+{
+    QList<QSpinBox*> spin_boxes = QList<QSpinBox*>()
+            << ui->spinBoxGraphX << ui->spinBoxGraphY << ui->spinBoxGraphW << ui->spinBoxGraphH
+            << ui->spinBoxLineWeight
+            << ui->spinBoxMarginLeft << ui->spinBoxMarginRight << ui->spinBoxMarginTop << ui->spinBoxMarginBottom
+            << ui->spinBoxXOffset << ui->spinBoxXRate << ui->spinBoxXWindow;
+    for(QSpinBox *box : spin_boxes) {
+        connect(box, QOverload<int>::of(&QSpinBox::valueChanged), this, [this]{ requestPreview(); });
+    }
+    QList<QDoubleSpinBox*> double_spin_boxes = QList<QDoubleSpinBox*>()
+            << ui->doubleSpinBoxGraphAlpha << ui->doubleSpinBoxFpsSet
+            << ui->doubleSpinBoxXMin << ui->doubleSpinBoxXMax << ui->doubleSpinBoxYMin << ui->doubleSpinBoxYMax
+            << ui->doubleSpinBoxKeyOffset << ui->doubleSpinBoxKeyRate << ui->doubleSpinBoxDriftPpm;
+    for(QDoubleSpinBox *box : double_spin_boxes) {
+        connect(box, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, [this]{ requestPreview(); });
+    }
+    // rotation and scale move the output like the crop does
+    for(QDoubleSpinBox *box : QList<QDoubleSpinBox*>() << ui->doubleSpinBoxRotate << ui->doubleSpinBoxScale) {
+        connect(box, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, [this]{
+            updateOutputGeometry();
+            requestPreview();
+        });
+    }
+    QList<QCheckBox*> check_boxes = QList<QCheckBox*>()
+            << ui->checkBoxTightenX << ui->checkBoxTightenY
+            << ui->checkBoxAutoScaleX << ui->checkBoxAutoScaleY << ui->checkBoxSmoothScaleY
+            << ui->checkBoxAlignTimestamps;
+    for(QCheckBox *box : check_boxes) {
+        connect(box, &QCheckBox::toggled, this, [this]{ requestPreview(); });
+    }
+    for(QLineEdit *edit : QList<QLineEdit*>() << ui->lineEditXLabel << ui->lineEditYLabel) {
+        connect(edit, &QLineEdit::textChanged, this, [this]{ requestPreview(); });
+    }
+    // checked columns and colors
+    connect(ui->listWidgetSeries, &QListWidget::itemChanged, this, [this]{ requestPreview(); });
+}
 
-    // create an axes object over the source image
-    //auto axes = CvPlot::plotImage(m_source, cv::Rect2d(0,0,frame_rect.width(), frame_rect.height()));
-    double frame = ui->spinBoxFrame->value();
+// composite the shown frame again on the preview thread, from the decoded
+// frame. A frame the pipeline showed is decoded again first; a capture
+// device has no frame to go back to. While playing, the settings go to
+// the pipeline instead.
+void MainWindow::requestPreview(bool new_frame)
+{
+    // the sparkline maps frames to rows with the same settings
+    CompositorSettings settings = compositorSettings();
+    ui->timeline->setGraph(m_graph, settings);
+    if(m_pipeline.isRunning()) {
+        // only on changes: every push makes each worker copy them again
+        m_pipeline.setSettings(settings);
+        return;
+    }
+    if(!m_video.isOpened()) {
+        return;
+    }
+    if(m_source_index != m_frame_index) {
+        if(m_frame_index >= 0 && !m_video.isDevice()) {
+            seekFrame(m_frame_index);
+        }
+        return;
+    }
+    if(m_source.empty()) {
+        return;
+    }
+    m_preview.request(m_source, m_source_index, m_source_time, settings, new_frame);
+    // restarting it on every request would starve it while a slider moves
+    if(!m_preview_timer->isActive()) {
+        m_preview_timer->start();
+    }
+}
 
-    // calculate data rate relatie to video frame rate
-    double coeff = static_cast<double>(ui->spinBoxXRate->value())/ui->doubleSpinBoxFpsSet->value();
+void MainWindow::onPreviewTimerTimeout()
+{
+    if(m_pipeline.isRunning()) {
+        m_preview_timer->stop();
+        return;
+    }
+    PreviewRenderer::Result result;
+    if(m_preview.take(backBuffer(m_display), backBuffer(m_graph_display), m_preview_frame, result)) {
+        if(result.background_changed) {
+            m_frame_item->setFrame(frontBuffer(m_display));
+        }
+        if(result.graph_rect.area() > 0) {
+            m_graph_item->setFrame(frontBuffer(m_graph_display));
+            m_graph_item->setPos(result.graph_rect.x, result.graph_rect.y);
+            m_graph_item->show();
+        }
+        else {
+            m_graph_item->hide();
+        }
+        // stepped frames are recorded, settings being edited are not
+        if(result.new_frame && m_encoder.isOpened()) {
+            writeFrame(m_preview_frame);
+        }
+    }
+    else if(m_preview.isIdle()) {
+        m_preview_timer->stop();
+    }
+}
 
+// the buffer to write the next frame into
+cv::Mat& MainWindow::backBuffer(DisplayBuffers &buffers)
+{
+    return buffers.mats[buffers.front ^ 1];
+}
 
-    int offset = ui->spinBoxXOffset->value() + frame*coeff;
-    int window = ui->spinBoxXWindow->value();
-    QVector<double> frame_keys = m_graph_keys.mid(offset, window);
-    QVector<double> frame_values = m_graph_values.mid(offset, window);
-    //qDebug()<<"coeff:"<<coeff<<"offset:"<<offset<<"n pts:"<<frame_keys.length();
+// flips the pair and returns the buffer just written
+cv::Mat& MainWindow::frontBuffer(DisplayBuffers &buffers)
+{
+    buffers.front ^= 1;
+    return buffers.mats[buffers.front];
+}
 
-    //auto axes = CvPlot::plot(std::vector<double>(frame_values.begin(), frame_values.end()), "-b");
+void MainWindow::showFrame(int frame)
+{
+    // composited by the pipeline, graph included, already in back buffer
+    m_frame_item->setFrame(frontBuffer(m_display));
+    m_graph_item->hide();
+    updateFrameCounter(frame);
+}
 
-    auto axes = CvPlot::makePlotAxes();
+void MainWindow::updateFrameCounter(int frame)
+{
+    m_frame_index = frame;
+    ui->timeline->setCurrentFrame(frame);
 
-    axes.create<CvPlot::Series>(std::vector<double>(frame_keys.begin(), frame_keys.end()),std::vector<double>(frame_values.begin(), frame_values.end()), "-b").setLineWidth(ui->spinBoxLineWeight->value());
+    QSignalBlocker blocker(ui->spinBoxFrame);
 
-    axes.setMargins(ui->spinBoxMarginLeft->value(),ui->spinBoxMarginRight->value(),ui->spinBoxMarginTop->value(),ui->spinBoxMarginBottom->value());
+    frame++;
+    ui->spinBoxFrame->setValue(frame);
 
-    axes.enableHorizontalGrid();
-    int x = ui->spinBoxGraphX->value();
-    int y = ui->spinBoxGraphY->value();
-    int w = ui->spinBoxGraphW->value();
-    int h = ui->spinBoxGraphH->value();
+    ui->labelCurrentFps->setText(QString("FPS: %1").arg(QString::number(1000.0/m_fps_timer->elapsed(),'f',2)));
 
-    cv::Rect rect(x, y, w ,h);
-    cv::Mat roi = m_source(rect);
-    //qDebug()<<"frame rect:"<<frame_rect;
-    // axes.setYLimAuto(false);
-    axes.xLabel(ui->lineEditXLabel->text().toStdString());
-    axes.yLabel(ui->lineEditYLabel->text().toStdString());
+    m_fps_timer->restart();
+}
 
-    // check tightness
-    if(ui->checkBoxTightenX->isChecked()) {
-        axes.setXTight(true);
-    }
-    if(ui->checkBoxTightenY->isChecked()) {
-        axes.setYTight(true);
-    }
+void MainWindow::updatePipelineLabel()
+{
+    FramePipeline::Stats stats = m_pipeline.stats();
+    ui->labelPipeline->setText(QString("queue: %1/%2 ready: %3\ndecoder stalls: %4 late: %5")
+                               .arg(stats.in_flight).arg(stats.capacity).arg(stats.ready)
+                               .arg(stats.decoder_stalls).arg(stats.output_misses));
+    updateCacheLabel();
+    updateEncoderLabel();
+}
 
-    // check axes scaling
-    if(ui->checkBoxAutoScaleX->isChecked()){
-        axes.setXLimAuto(true);
-    }
-    else {
-        axes.setXLimAuto(false);
-        double min = ui->doubleSpinBoxXMin->value();
-        double max = ui->doubleSpinBoxXMax->value();
-        axes.setXLim(std::pair<double,double>(min, max));
-    }
-    if(ui->checkBoxAutoScaleY->isChecked()){
-        axes.setYLimAuto(true);
-    }
-    else {
-        axes.setYLimAuto(false);
-        double min = ui->doubleSpinBoxYMin->value();
-        double max = ui->doubleSpinBoxYMax->value();
-        axes.setYLim(std::pair<double,double>(min, max));
+// the view and the graph rect are in output pixels; from the size kept at
+// open, as the pipeline's decoder may be reading m_video
+void MainWindow::updateOutputGeometry()
+{
+    if(m_source_size.area() <= 0) {
+        return;
     }
+    cv::Size output = compositorSettings().outputSize(m_source_size);
+    ui->graphicsView->setSceneRect(0, 0, output.width, output.height);
 
-    cv::Mat graph_mat = axes.render(rect.height,rect.width);
-
-    double alpha = ui->doubleSpinBoxGraphAlpha->value();
-    double beta = ( 1.0 - alpha );
-    addWeighted( graph_mat, alpha, roi, beta, 0.0, roi);
+    ui->spinBoxGraphY->setRange(0,output.height);
+    ui->spinBoxGraphX->setRange(0,output.width);
+    ui->spinBoxGraphH->setRange(0,output.height);
+    ui->spinBoxGraphW->setRange(0,output.width);
+}
 
-    roi.copyTo(m_source(rect));
+QList<QSpinBox*> MainWindow::outputGeometryBoxes() const
+{
+    return QList<QSpinBox*>() << ui->spinBoxCropX << ui->spinBoxCropY
+                              << ui->spinBoxCropW << ui->spinBoxCropH
+                              << ui->spinBoxOutputW << ui->spinBoxOutputH;
+}
 
+void MainWindow::updateEncoderLabel()
+{
+    if(!m_encoder.isOpened()) {
+        ui->labelEncoder->setText("encoder: closed");
+        return;
+    }
+    VideoEncoder::Stats stats = m_encoder.stats();
+    ui->labelEncoder->setText(QString("encoder queue: %1/%2 %3 fps\nencoded: %4 stalls: %5")
+                              .arg(stats.queued).arg(stats.capacity)
+                              .arg(QString::number(stats.encode_fps, 'f', 1))
+                              .arg(stats.encoded).arg(stats.stalls));
+}
 
+EncoderSettings MainWindow::encoderSettings() const
+{
+    EncoderSettings s;
+    s.format = ui->comboBoxCodec->currentData().toString();
+    s.preset = ui->comboBoxPreset->currentText();
+    s.bitrate = ui->spinBoxBitrate->value();
+    s.quality = ui->spinBoxQuality->value();
+    return s;
+}
 
-    m_pixmap_frame->setPixmap(cvMatToQPixmap(m_source));
+void MainWindow::setEncoderSettings(const EncoderSettings &settings)
+{
+    ui->comboBoxCodec->setCurrentIndex(qMax(0, ui->comboBoxCodec->findData(settings.format)));
+    ui->comboBoxPreset->setCurrentText(settings.preset);
+    ui->spinBoxBitrate->setValue(settings.bitrate);
+    ui->spinBoxQuality->setValue(settings.quality);
+}
 
+// preset and bitrate only mean something to some codecs
+void MainWindow::on_comboBoxCodec_currentIndexChanged(int index)
+{
+    QString format = ui->comboBoxCodec->itemData(index).toString();
+    bool x26x = format == "h264" || format == "hevc";
+    ui->comboBoxPreset->setEnabled(x26x);
+    ui->spinBoxBitrate->setEnabled(format != "ffv1" && format != "avi");
+    ui->spinBoxQuality->setEnabled(format != "ffv1" && format != "mp4");
+}
 
-    /*  double avg = cv::mean(m_processed).val[0];
+void MainWindow::updateCacheLabel()
+{
+    FrameCache::Stats stats = m_video.cache().stats();
+    long long lookups = stats.hits + stats.misses;
+    m_cache_label->setText(QString("frame cache: %1 frames, %2/%3 MB, %4% hits")
+                           .arg(stats.frames)
+                           .arg(stats.bytes/(1024*1024)).arg(stats.budget/(1024*1024))
+                           .arg(lookups > 0 ? 100*stats.hits/lookups : 0));
+    updateTimingHud();
+}
 
-    if(ui->checkBoxCapture->isChecked()){
-        QString data = QString("%1,%2").arg(frame).arg(avg);
-        ui->textEdit->append(data);
+void MainWindow::updateTimingHud()
+{
+    if(!m_timing_hud->isVisible()) {
+        return;
     }
+    m_timing_text->setText(StageTimings::instance().report());
+    m_timing_hud->setRect(m_timing_text->boundingRect().adjusted(0, 0, 12, 8));
+}
 
-    ui->labelSource->setPixmap(cvMatToQPixmap(m_source));
-    ui->labelProcessed->setPixmap(cvMatToQPixmap(m_processed));*/
-
-    QSignalBlocker blocker(ui->spinBoxFrame);
-
-    frame++;
-    ui->spinBoxFrame->setValue(frame);
+void MainWindow::on_checkBoxTimingHud_toggled(bool checked)
+{
+    QSettings settings;
+    settings.setValue("timingHud", checked);
+    m_timing_hud->setVisible(checked);
+    updateTimingHud();
+}
 
-    ui->labelCurrentFps->setText(QString("FPS: %1").arg(QString::number(1000.0/m_fps_timer->elapsed(),'f',2)));
+void MainWindow::on_pushButtonExportTimings_clicked()
+{
+    QSettings settings;
+    QString last_dir = settings.value("lastTimingsFileName").toString();
+    QString file_name = QFileDialog::getSaveFileName(
+                this, tr("Export Timings"), last_dir, tr("CSV summary (*.csv);;Chrome trace (*.json)"));
+    if(file_name.isEmpty()) {
+        return;
+    }
+    settings.setValue("lastTimingsFileName", file_name);
 
-    if(m_writer.isOpened()) {
-        writeFrame(m_source);
+    const StageTimings &timings = StageTimings::instance();
+    bool trace = file_name.endsWith(".json", Qt::CaseInsensitive);
+    if(!(trace ? timings.writeTrace(file_name) : timings.writeCsv(file_name))) {
+        QMessageBox::warning(this, tr("Export Timings"), tr("Unable to write %1").arg(file_name));
     }
+    else if(trace && timings.droppedEvents() > 0) {
+        ui->statusbar->showMessage(QString("Trace is full, the last %1 calls are missing")
+                                   .arg(timings.droppedEvents()));
+    }
+}
 
-    m_fps_timer->restart();
+void MainWindow::on_spinBoxFrameCache_valueChanged(int arg1)
+{
+    QSettings settings;
+    settings.setValue("frameCacheMegabytes", arg1);
+    m_video.cache().setBudget(arg1*1024LL*1024);
+    updateCacheLabel();
 }
 
 void MainWindow::onTimerTimeout()
 {
-    if(m_capture.read(m_source)) {
-        handleFrame();
+    if(!m_pipeline.isRunning()) {
+        return;
     }
-    else {
-        if(ui->checkBoxLoop->isChecked()) {
-            if(m_capture.isOpened()) {
-                m_capture.set(cv::CAP_PROP_POS_FRAMES, 0);
-                ui->spinBoxFrame->setValue(0);
-                if(m_capture.read(m_source)) {
-                    handleFrame();
-                    return;
-                }
-            }
-            on_pushButtonPause_clicked();
+    m_pipeline.setLoop(ui->checkBoxLoop->isChecked());
+
+    int frame = 0;
+    if(m_pipeline.takeFrame(backBuffer(m_display), frame)) {
+        showFrame(frame);
+    }
+    else if(m_pipeline.isFinished()) {
+        on_pushButtonPause_clicked();
+    }
+    updatePipelineLabel();
+}
+
+void MainWindow::on_pushButtonLiveData_toggled(bool checked)
+{
+    if(m_live) {
+        m_live->stop();
+        m_live.reset();
+    }
+    if(checked) {
+        QString address = ui->lineEditLiveSource->text().trimmed();
+        m_live = LiveSource::create(address);
+        if(m_live && m_live->start()) {
+            QSettings settings;
+            settings.setValue("liveSource", address);
+            ui->statusbar->showMessage(QString("Following live data from %1").arg(address));
         }
         else {
-            on_pushButtonPause_clicked();
+            m_live.reset();
+            ui->statusbar->showMessage(QString("Unusable live data source \"%1\"").arg(address));
+            QSignalBlocker blocker(ui->pushButtonLiveData);
+            ui->pushButtonLiveData->setChecked(false);
         }
     }
+    m_preview.setLiveSource(m_live);
+    m_pipeline.setLiveSource(m_live);
+
+    if(m_live) {
+        m_live_pushed = -1;
+        m_live_timer->start(1000.0/ui->doubleSpinBoxFpsSet->value());
+    }
+    else {
+        m_live_timer->stop();
+        requestPreview();
+    }
+}
+
+void MainWindow::onLiveTimerTimeout()
+{
+    if(!m_live) {
+        m_live_timer->stop();
+        return;
+    }
+    // while playing the pipeline picks up the samples with every frame;
+    // paused, the shown frame is composited again, but only with new ones
+    std::shared_ptr<const SampleRing> ring = m_live->ring();
+    long long pushed = ring ? ring->pushed() : 0;
+    if(!m_pipeline.isRunning() && pushed != m_live_pushed) {
+        m_live_pushed = pushed;
+        requestPreview();
+    }
+    if(!m_live->isRunning()) {
+        // connection refused or closed; keep showing what arrived
+        ui->statusbar->showMessage(QString("Live data from %1 ended").arg(m_live->address()));
+        m_live_timer->stop();
+    }
+}
+
+// show frame and leave the spin box on it
+void MainWindow::seekFrame(int frame)
+{
+    // a new buffer, the preview thread may still read the last one
+    cv::Mat decoded;
+    double time_ms = 0.0;
+    if(!m_video.read(frame, decoded, &time_ms)) {
+        return;
+    }
+    m_source = decoded;
+    m_source_index = frame;
+    m_source_time = time_ms;
+    ui->spinBoxFrame->setSuffix(QString("/%1").arg(m_video.frameCount()));
+    // exact once the keyframe index is ready
+    ui->timeline->setFrameCount(m_video.frameCount());
+
+    updateFrameCounter(frame);
+    requestPreview(true);
+    updateCacheLabel();
 }
 
 void MainWindow::on_pushButtonFrameBack_clicked()
 {
-    if(m_capture.isOpened()) {
-        double frame = m_capture.get(cv::CAP_PROP_POS_FRAMES);
-        m_capture.set(cv::CAP_PROP_POS_FRAMES, frame - 2);
-        if(m_capture.read(m_source))
-            handleFrame();
-        QSignalBlocker blocker(ui->spinBoxFrame);
-        ui->spinBoxFrame->setValue(frame - 2);
+    if(m_pipeline.isRunning()) {
+        on_pushButtonPause_clicked();
+    }
+    if(m_video.isOpened()) {
+        seekFrame(m_frame_index - 1);
     }
 }
 
 void MainWindow::on_pushButtonFrameForward_clicked()
 {
-    if(m_capture.isOpened()) {
-        double frame = m_capture.get(cv::CAP_PROP_POS_FRAMES);
-        m_capture.set(cv::CAP_PROP_POS_FRAMES, frame);
-        if(m_capture.read(m_source))
-            handleFrame();
-        QSignalBlocker blocker(ui->spinBoxFrame);
-        ui->spinBoxFrame->setValue(frame);
+    if(m_pipeline.isRunning()) {
+        on_pushButtonPause_clicked();
+    }
+    if(m_video.isOpened()) {
+        seekFrame(m_frame_index + 1);
     }
 }
 
 void MainWindow::on_spinBoxFrame_valueChanged(int arg1)
 {
-    if(m_capture.isOpened()) {
-        m_capture.set(cv::CAP_PROP_POS_FRAMES, arg1);
-        if(m_capture.read(m_source))
-            handleFrame();
-        QSignalBlocker blocker(ui->spinBoxFrame);
-        ui->spinBoxFrame->setValue(arg1);
+    if(m_pipeline.isRunning()) {
+        on_pushButtonPause_clicked();
+    }
+    // the box counts from 1
+    if(m_video.isOpened()) {
+        seekFrame(arg1 - 1);
     }
 }
 
 
 void MainWindow::on_spinBoxFrame_editingFinished()
 {
-    if(m_capture.isOpened()) {
-        //double frame = m_capture.get(cv::CAP_PROP_POS_FRAMES);
-        double frame = ui->spinBoxFrame->value();
-        m_capture.set(cv::CAP_PROP_POS_FRAMES, frame - 1);
-        if(m_capture.read(m_source))
-            handleFrame();
-        QSignalBlocker blocker(ui->spinBoxFrame);
-        ui->spinBoxFrame->setValue(frame - 1);
+    if(m_pipeline.isRunning()) {
+        on_pushButtonPause_clicked();
+    }
+    if(m_video.isOpened()) {
+        seekFrame(ui->spinBoxFrame->value() - 1);
     }
 }
 
@@ -304,17 +712,17 @@ void MainWindow::on_pushButtonLoadGraph_clicked()
     if(file_name.isEmpty()) {
         return;
     }
-    QFile file(file_name);
-    if( file.open(QFile::ReadOnly) ){
-        QString data(file.readAll());
-        m_graph_data = data.split("\n");
+    m_graph_file = file_name;
 
-        // handle headers
-        on_checkBoxHasHeaders_clicked();
+    // handle headers
+    on_checkBoxHasHeaders_clicked();
+    if(m_graph) {
+        qDebug()<<"loaded"<<m_graph->count()<<"graph values...";
+        ui->statusbar->showMessage(QString("Loaded %1 graph values, %2 malformed rows")
+                                   .arg(m_graph->count()).arg(m_graph->malformedRows()));
     }
 
     settings.setValue("lastLoadGraphName",file_name);
-    qDebug()<<"loaded"<<m_graph_values.length()<<"graph values...";
 }
 /////
 
@@ -335,9 +743,11 @@ void MainWindow::on_pushButtonZoomIn_clicked()
 void MainWindow::on_doubleSpinBoxFpsSet_valueChanged(double arg1)
 {
     qDebug()<<"try set fps";
-    if(m_capture.isOpened()) {
-        m_capture.set(cv::CAP_PROP_FPS, arg1);
-        qDebug()<<"set capture fps:"<<arg1;
+    if(m_video.isOpened()) {
+        if(!m_pipeline.isRunning()) {
+            m_video.set(cv::CAP_PROP_FPS, arg1);
+            qDebug()<<"set capture fps:"<<arg1;
+        }
         m_timer->setInterval(1000.0/arg1);
     }
 }
@@ -347,18 +757,22 @@ void MainWindow::on_pushButtonOpenWriter_clicked()
     QSettings settings;
     QString last_dir = settings.value("lastVideoSaveFileName").toString();
 
+    // FFV1 needs a container that can hold it
+    EncoderSettings encoder = encoderSettings();
+    QString filter = encoder.format == "avi" ? tr("AVI (*.avi)")
+                   : encoder.format == "ffv1" ? tr("Matroska (*.mkv)") : tr("MP4 (*.mp4)");
     QString file_name = QFileDialog::getSaveFileName(
-                this, tr("Write Video"), last_dir, tr("MP4 (*.mp4)"));
+                this, tr("Write Video"), last_dir, filter);
 
     if(!file_name.isEmpty()) {
         ui->lineEditFileNameOut->setText(file_name);
 
         settings.setValue("lastVideoSaveFileName",file_name);
+        encoder.save(settings);
 
         QRect frame_rect = ui->graphicsView->sceneRect().toRect();
-        double fps = ui->doubleSpinBoxFpsSet->value();
 
-        startVideoRecording(ui->lineEditFileNameOut->text(), "mp4", frame_rect.width(), frame_rect.height(), ui->doubleSpinBoxWriterFps->value());
+        startVideoRecording(ui->lineEditFileNameOut->text(), encoder, frame_rect.width(), frame_rect.height(), ui->doubleSpinBoxWriterFps->value());
     }
 
 
@@ -372,82 +786,124 @@ void MainWindow::on_pushButtonCloseWriter_clicked()
 
 void MainWindow::on_checkBoxHasHeaders_clicked()
 {
-    m_graph_values.clear();
-    m_graph_keys.clear();
-
-    if(ui->checkBoxHasHeaders->isChecked()) {
-        // set ui labels with headers
-        QString headers = m_graph_data.first();
-        QStringList headers_split = headers.split(",");
-        if(headers_split.length() >= 2) {
-            // m_graph_values.pop_front(); // remove header entries
-            ui->lineEditXLabel->setText(headers_split.at(0).trimmed());
-            ui->lineEditYLabel->setText(headers_split.at(1).trimmed());
-        }
-
-        m_graph_values.reserve(m_graph_data.length() - 1);
-        m_graph_keys.reserve(m_graph_data.length() - 1);
-        foreach(QString value, m_graph_data.mid(1)) {
-            QStringList data_split = value.split(",");
-            if(data_split.length() >= 2) {
-                m_graph_keys << data_split.at(0).toDouble();
-                m_graph_values << data_split.at(1).toDouble();
-            }
-        }
+    if(m_graph_file.isEmpty()) {
+        return;
     }
-    else {
-        m_graph_values.reserve(m_graph_data.length());
-        m_graph_keys.reserve(m_graph_data.length());
-        foreach(QString value, m_graph_data) {
-            QStringList data_split = value.split(",");
-            if(data_split.length() >= 2) {
-                m_graph_keys << data_split.at(0).toDouble();
-                m_graph_values << data_split.at(1).toDouble();
-            }
-        }
+    // reloads come from the column cache, so toggling headers is cheap
+    bool has_headers = ui->checkBoxHasHeaders->isChecked();
+    m_graph = GraphData::load(m_graph_file, has_headers, [this](qint64 done, qint64 total) {
+        ui->statusbar->showMessage(QString("Parsing graph data... %1%").arg(100*done/qMax(total, qint64(1))));
+        ui->statusbar->repaint();
+    });
+    m_preview.setGraphData(m_graph);
+    m_pipeline.setGraphData(m_graph);
+    if(!m_graph) {
+        return;
     }
-}
 
+    // set ui labels with headers
+    if(has_headers && !m_graph->xLabel().isEmpty()) {
+        ui->lineEditXLabel->setText(m_graph->xLabel());
+        ui->lineEditYLabel->setText(m_graph->yLabel());
+    }
+    updateSeriesList();
+    requestPreview();
+}
 
-void MainWindow::startVideoRecording(const QString &file_name, const QString &format, int w, int h, double fps)
+void MainWindow::updateSeriesList()
 {
-    // the writer is automatically closed if it was already open
-    int fcc = -1;
-    if(format == "mp4") {
-        fcc = cv::VideoWriter::fourcc('m','p','4','v');
+    // keep the picked columns and colors when the same file is reloaded
+    QVector<bool> checked;
+    QVector<QColor> colors;
+    for(int i = 0; i < ui->listWidgetSeries->count(); ++i) {
+        QListWidgetItem *item = ui->listWidgetSeries->item(i);
+        checked << (item->checkState() == Qt::Checked);
+        colors << item->data(Qt::DecorationRole).value<QColor>();
+    }
+    bool keep = checked.length() == m_graph->columnCount() - 1;
+
+    ui->listWidgetSeries->clear();
+    for(int c = 1; c < m_graph->columnCount(); ++c) {
+        cv::Scalar bgr = SeriesStyle::defaultColor(c - 1);
+        QColor color = keep ? colors.at(c - 1) : QColor(bgr[2], bgr[1], bgr[0]);
+
+        QListWidgetItem *item = new QListWidgetItem(m_graph->columnName(c), ui->listWidgetSeries);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState((keep ? checked.at(c - 1) : c == 1) ? Qt::Checked : Qt::Unchecked);
+        item->setData(Qt::DecorationRole, color);
+        item->setData(Qt::UserRole, c);
     }
-    if(format == "avi") {
-        fcc = cv::VideoWriter::fourcc('M','J','P','G');
+}
+
+void MainWindow::on_listWidgetSeries_itemDoubleClicked(QListWidgetItem *item)
+{
+    QColor color = QColorDialog::getColor(item->data(Qt::DecorationRole).value<QColor>(),
+                                          this, tr("Series Color"));
+    if(color.isValid()) {
+        item->setData(Qt::DecorationRole, color);
     }
-    if(format == "h264"){
-        fcc = cv::VideoWriter::fourcc('h','2','6','4');
+}
+
+void MainWindow::on_pushButtonSaveSettings_clicked()
+{
+    QSettings settings;
+    QString last_dir = settings.value("lastSettingsFileName").toString();
+
+    QString file_name = QFileDialog::getSaveFileName(
+                this, tr("Save Overlay Settings"), last_dir, tr("Settings (*.ini)"));
+    if(file_name.isEmpty()) {
+        return;
     }
+    settings.setValue("lastSettingsFileName", file_name);
+
+    // the same file drives a headless render: CvMoviePlot --batch --settings <file>
+    QSettings file_settings(file_name, QSettings::IniFormat);
+    compositorSettings().save(file_settings);
+    encoderSettings().save(file_settings);
+}
+
+
+void MainWindow::startVideoRecording(const QString &file_name, const EncoderSettings &settings, int w, int h, double fps)
+{
+    // the encoder is automatically closed if it was already open
+    m_pipeline.setWriter(nullptr);
 
-    //int fcc = cv::VideoWriter::fourcc('H','2','6','4');
-    //int fcc = cv::VideoWriter::fourcc('m','p','4','v');
     cv::Size s(w, h);
-    if(m_writer.open(file_name.toStdString(), fcc, fps, s)){
-        qDebug()<< QString("Recording video (%1 x %2, %3 FPS) to:" + file_name).arg(w).arg(h).arg(fps);
+    if(m_encoder.open(file_name, settings, fps, s)){
+        qDebug()<< QString("Recording %1 video (%2 x %3, %4 FPS) to:" + file_name).arg(settings.format).arg(w).arg(h).arg(fps);
+        m_pipeline.setWriter(&m_encoder);
+        // the writer's frame size is fixed until it is closed
+        for(QSpinBox *box : outputGeometryBoxes()) {
+            box->setEnabled(false);
+        }
     }
     else {
         qDebug()<< "Unable to record video to:" << file_name;
     }
+    updateEncoderLabel();
 }
 
 void MainWindow::stopVideoRecording()
 {
-    m_writer.release();
+    m_pipeline.setWriter(nullptr);
+    // encodes the frames still queued
+    m_encoder.close();
+    for(QSpinBox *box : outputGeometryBoxes()) {
+        box->setEnabled(true);
+    }
+    updateEncoderLabel();
     qDebug()<<"Video recording stopped";
 }
 
 void MainWindow::writeFrame(const cv::Mat &frame)
 {
-    if(m_writer.isOpened()) {
+    if(m_encoder.isOpened()) {
         if(frame.empty()) {
             qDebug()<<"empty frame";
         }
-        m_writer.write(frame);
-        //qDebug()<<"wrote frame"<<frame.cols<<frame.ows<<frame.channels();
+        // copied into the encoder's queue, encoded on its thread
+        m_encoder.write(frame, m_frame_index);
+        updateEncoderLabel();
     }
     else {
         qDebug()<<"writer closed";
@@ -464,6 +920,7 @@ void MainWindow::on_checkBoxAutoScaleY_toggled(bool checked)
 {
     ui->doubleSpinBoxYMin->setEnabled(!checked);
     ui->doubleSpinBoxYMax->setEnabled(!checked);
+    ui->checkBoxSmoothScaleY->setEnabled(checked);
 }
 
 // check limits
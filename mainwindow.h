@@ -5,12 +5,25 @@
 #include <opencv2/core.hpp>
 #include <opencv2/videoio.hpp>
 #include <QDebug>
+#include <memory>
+
+#include "framecompositor.h"
+#include "framepipeline.h"
+#include "livesource.h"
+#include "previewrenderer.h"
+#include "thumbnailstrip.h"
+#include "videoencoder.h"
+#include "videosource.h"
 
 class SizeGripItem;
 class QGraphicsScene;
-class QGraphicsPixmapItem;
+class FrameItem;
 class QLabel;
+class QGraphicsRectItem;
+class QGraphicsSimpleTextItem;
 class QElapsedTimer;
+class QListWidgetItem;
+class QSpinBox;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -26,9 +39,12 @@ public:
 
 public slots:
     void onTimerTimeout();
+    void onLiveTimerTimeout();
+    void onPreviewTimerTimeout();
 
 private slots:
     void on_pushButtonLoadVideo_clicked();
+    void on_lineEditFileName_returnPressed();
 
     void on_pushButtonPlay_clicked();
     void on_pushButtonPause_clicked();
@@ -65,125 +81,91 @@ private slots:
 
     void on_spinBoxGraphH_valueChanged(int arg1);
 
+    void on_pushButtonSaveSettings_clicked();
+
+    void on_listWidgetSeries_itemDoubleClicked(QListWidgetItem *item);
+
+    void on_spinBoxFrameCache_valueChanged(int arg1);
+
+    void on_pushButtonLiveData_toggled(bool checked);
+
+    void on_checkBoxTimingHud_toggled(bool checked);
+
+    void on_pushButtonExportTimings_clicked();
+
+    void on_comboBoxCodec_currentIndexChanged(int index);
+
 private:
     Ui::MainWindow *ui;
     QGraphicsScene* m_scene;
-    QGraphicsPixmapItem* m_pixmap_frame;
-    QStringList m_graph_data;
-    QVector<double> m_graph_keys;
-    QVector<double> m_graph_values;
-
-    cv::VideoCapture m_capture;
+    FrameItem* m_frame_item;
+    FrameItem* m_graph_item;
+    QString m_graph_file;
+    std::shared_ptr<GraphData> m_graph;
+    // composites the paused frame again as settings change
+    PreviewRenderer m_preview;
+    FramePipeline m_pipeline;
+    std::shared_ptr<LiveSource> m_live;
+    // rows the shown frame was composited with, -1 for none yet
+    long long m_live_pushed = -1;
+
+    VideoSource m_video;
+    // frame size of m_video, read once at open
+    cv::Size m_source_size;
+    // timeline thumbnails; reads m_video's keyframe index, so it is
+    // declared after it and stopped first
+    ThumbnailStrip m_thumbnails;
+    // the decoded frame, never composited into; every decode gets a new
+    // buffer while the preview may still read the last one
     cv::Mat m_source;
-    cv::VideoWriter m_writer;
+    int m_source_index = -1;
+    double m_source_time = 0.0;     // ms
+    int m_frame_index = -1;
+    // BGR frame of the last preview, graph included, for the encoder
+    cv::Mat m_preview_frame;
+
+    // BGRX frames for the view: one shown, one being written
+    struct DisplayBuffers
+    {
+        cv::Mat mats[2];
+        int front = 0;
+    };
+    DisplayBuffers m_display;
+    DisplayBuffers m_graph_display;
+    static cv::Mat& backBuffer(DisplayBuffers &buffers);
+    static cv::Mat& frontBuffer(DisplayBuffers &buffers);
+    VideoEncoder m_encoder;
     QElapsedTimer* m_fps_timer;
 
     QTimer* m_timer;
-    void handleFrame();
-
-    void startVideoRecording(const QString &file_name, const QString& format, int w, int h, double fps);
+    QTimer* m_live_timer;
+    QTimer* m_preview_timer;
+    QLabel* m_cache_label;
+    // stage timings drawn over the view, unscaled
+    QGraphicsRectItem* m_timing_hud;
+    QGraphicsSimpleTextItem* m_timing_text;
+    void requestPreview(bool new_frame = false);
+    void connectPreviewInputs();
+    void showFrame(int frame);
+    void updateFrameCounter(int frame);
+    void seekFrame(int frame);
+    void openVideo(const QString &file_name);
+    double videoFps() const;
+    void updatePipelineLabel();
+    void updateCacheLabel();
+    void updateEncoderLabel();
+    void updateOutputGeometry();
+    QList<QSpinBox*> outputGeometryBoxes() const;
+    void updateTimingHud();
+    void updateSeriesList();
+    CompositorSettings compositorSettings() const;
+    EncoderSettings encoderSettings() const;
+    void setEncoderSettings(const EncoderSettings &settings);
+
+    void startVideoRecording(const QString &file_name, const EncoderSettings &settings, int w, int h, double fps);
     void stopVideoRecording();
     void writeFrame(const cv::Mat &frame);
 };
 
 
-static inline QImage  cvMatToQImage( const cv::Mat &inMat )
-{
-    switch ( inMat.type() )
-    {
-    // 8-bit, 4 channel
-    case CV_8UC4:
-    {
-        QImage image( inMat.data, inMat.cols, inMat.rows, inMat.step, QImage::Format_RGB32 );
-
-        return image;
-    }
-
-        // 8-bit, 3 channel
-    case CV_8UC3:
-    {
-        QImage image( inMat.data, inMat.cols, inMat.rows, inMat.step, QImage::Format_RGB888 );
-
-        return image.rgbSwapped();
-    }
-
-        // 8-bit, 1 channel
-    case CV_8UC1:
-    {
-        static QVector<QRgb>  sColorTable;
-
-        // only create our color table once
-        if ( sColorTable.isEmpty() )
-        {
-            for ( int i = 0; i < 256; ++i )
-                sColorTable.push_back( qRgb( i, i, i ) );
-        }
-
-        QImage image( inMat.data, inMat.cols, inMat.rows, inMat.step, QImage::Format_Indexed8 );
-
-        image.setColorTable( sColorTable );
-
-        return image;
-    }
-
-    default:
-        qWarning() << "ASM::cvMatToQImage() - cv::Mat image type not handled in switch:" << inMat.type();
-        break;
-    }
-
-    return QImage();
-}
-
-static inline QPixmap cvMatToQPixmap( const cv::Mat &inMat )
-{
-    return QPixmap::fromImage( cvMatToQImage( inMat ) );
-}
-
-static inline cv::Mat QImageToCvMat( const QImage &inImage, bool inCloneImageData = true )
-{
-    switch ( inImage.format() )
-    {
-    // 8-bit, 4 channel
-    case QImage::Format_RGB32:
-    {
-        cv::Mat  mat( inImage.height(), inImage.width(), CV_8UC4, const_cast<uchar*>(inImage.bits()), inImage.bytesPerLine() );
-
-        return (inCloneImageData ? mat.clone() : mat);
-    }
-
-        // 8-bit, 3 channel
-    case QImage::Format_RGB888:
-    {
-        if ( !inCloneImageData )
-            qWarning() << "ASM::QImageToCvMat() - Conversion requires cloning since we use a temporary QImage";
-
-        QImage   swapped = inImage.rgbSwapped();
-
-        return cv::Mat( swapped.height(), swapped.width(), CV_8UC3, const_cast<uchar*>(swapped.bits()), swapped.bytesPerLine() ).clone();
-    }
-
-        // 8-bit, 1 channel
-    case QImage::Format_Indexed8:
-    {
-        cv::Mat  mat( inImage.height(), inImage.width(), CV_8UC1, const_cast<uchar*>(inImage.bits()), inImage.bytesPerLine() );
-
-        return (inCloneImageData ? mat.clone() : mat);
-    }
-
-    default:
-        qWarning() << "ASM::QImageToCvMat() - QImage format not handled in switch:" << inImage.format();
-        break;
-    }
-
-    return cv::Mat();
-}
-
-// If inPixmap exists for the lifetime of the resulting cv::Mat, pass false to inCloneImageData to share inPixmap's data
-// with the cv::Mat directly
-//    NOTE: Format_RGB888 is an exception since we need to use a local QImage and thus must clone the data regardless
-static inline cv::Mat QPixmapToCvMat( const QPixmap &inPixmap, bool inCloneImageData = true )
-{
-    return QImageToCvMat( inPixmap.toImage(), inCloneImageData );
-}
-
 #endif // MAINWINDOW_H
@@ -0,0 +1,193 @@
+#include "minmaxpyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+MinMaxPyramid::MinMaxPyramid()
+{
+}
+
+void MinMaxPyramid::merge(int index, int &min_index, int &max_index) const
+{
+    if(index < 0 || std::isnan(m_values[index])) {
+        return;
+    }
+    if(min_index < 0 || m_values[index] < m_values[min_index]) {
+        min_index = index;
+    }
+    if(max_index < 0 || m_values[index] > m_values[max_index]) {
+        max_index = index;
+    }
+}
+
+size_t MinMaxPyramid::layout(int count, std::vector<size_t> *offsets, std::vector<int> *blocks)
+{
+    if(offsets) {
+        offsets->clear();
+    }
+    if(blocks) {
+        blocks->clear();
+    }
+    // the first level straight from the samples, every further one pairs
+    // two blocks of the one below
+    size_t size = 0;
+    for(int level_blocks = count/base_block; level_blocks >= 1; level_blocks /= 2) {
+        if(offsets) {
+            offsets->push_back(size);
+        }
+        if(blocks) {
+            blocks->push_back(level_blocks);
+        }
+        size += 2*static_cast<size_t>(level_blocks);
+        if(level_blocks < 2) {
+            break;
+        }
+    }
+    return size;
+}
+
+size_t MinMaxPyramid::storageSize(int count)
+{
+    return layout(count, nullptr, nullptr);
+}
+
+void MinMaxPyramid::attach(const double *values, int count, const int *storage)
+{
+    m_values = values;
+    m_count = count;
+    std::vector<int>().swap(m_owned);
+    m_storage = storage;
+    layout(count, &m_level_offsets, &m_level_blocks);
+}
+
+void MinMaxPyramid::build(const double *values, int count)
+{
+    m_values = values;
+    m_count = count;
+    m_storage = nullptr;
+    m_owned.assign(layout(count, &m_level_offsets, &m_level_blocks), -1);
+    if(m_level_blocks.empty()) {
+        return;
+    }
+
+    int *level = m_owned.data();
+    for(int b = 0; b < m_level_blocks[0]; ++b) {
+        int min_index = -1;
+        int max_index = -1;
+        for(int i = b*base_block; i < (b + 1)*base_block; ++i) {
+            merge(i, min_index, max_index);
+        }
+        level[2*b] = min_index;
+        level[2*b + 1] = max_index;
+    }
+
+    for(size_t l = 1; l < m_level_blocks.size(); ++l) {
+        const int *below = m_owned.data() + m_level_offsets[l - 1];
+        int *next = m_owned.data() + m_level_offsets[l];
+        for(int b = 0; b < m_level_blocks[l]; ++b) {
+            int min_index = -1;
+            int max_index = -1;
+            merge(below[4*b], min_index, max_index);
+            merge(below[4*b + 2], min_index, max_index);
+            merge(below[4*b + 1], min_index, max_index);
+            merge(below[4*b + 3], min_index, max_index);
+            next[2*b] = min_index;
+            next[2*b + 1] = max_index;
+        }
+    }
+}
+
+void MinMaxPyramid::extremes(int begin, int end, int &min_index, int &max_index) const
+{
+    min_index = -1;
+    max_index = -1;
+    const int *levels = storage();
+    int pos = begin;
+    while(pos < end) {
+        // the largest aligned block starting at pos that fits the range
+        bool found = false;
+        for(int l = static_cast<int>(m_level_blocks.size()) - 1; l >= 0; --l) {
+            int size = base_block << l;
+            int block = pos/size;
+            if(pos % size == 0 && pos + size <= end && block < m_level_blocks[l]) {
+                const int *level = levels + m_level_offsets[l];
+                merge(level[2*block], min_index, max_index);
+                merge(level[2*block + 1], min_index, max_index);
+                pos += size;
+                found = true;
+                break;
+            }
+        }
+        if(!found) {
+            merge(pos, min_index, max_index);
+            ++pos;
+        }
+    }
+}
+
+bool MinMaxPyramid::range(int first, int last, double &min, double &max) const
+{
+    int min_index = -1;
+    int max_index = -1;
+    extremes(std::max(first, 0), std::min(last, m_count), min_index, max_index);
+    if(min_index < 0) {
+        return false;
+    }
+    min = m_values[min_index];
+    max = m_values[max_index];
+    return true;
+}
+
+void MinMaxPyramid::decimate(const double *keys, int first, int last, int max_points,
+                             std::vector<double> &out_keys, std::vector<double> &out_values) const
+{
+    first = std::max(first, 0);
+    last = std::min(last, m_count);
+    out_keys.clear();
+    out_values.clear();
+    if(last <= first) {
+        return;
+    }
+    int count = last - first;
+    if(count <= max_points || max_points < 2) {
+        out_keys.assign(keys + first, keys + last);
+        out_values.assign(m_values + first, m_values + last);
+        return;
+    }
+
+    // two points per bucket, plus the window ends so the line and the
+    // x range still span the whole window
+    int buckets = max_points/2;
+    out_keys.reserve(2*buckets + 2);
+    out_values.reserve(2*buckets + 2);
+    int previous = first;
+    out_keys.push_back(keys[first]);
+    out_values.push_back(m_values[first]);
+    for(int b = 0; b < buckets; ++b) {
+        int begin = first + static_cast<int>(static_cast<long long>(count)*b/buckets);
+        int end = first + static_cast<int>(static_cast<long long>(count)*(b + 1)/buckets);
+        int min_index = -1;
+        int max_index = -1;
+        extremes(begin, end, min_index, max_index);
+        if(min_index < 0) {
+            // nothing but NaN: keep the gap in the line
+            out_keys.push_back(keys[begin]);
+            out_values.push_back(std::numeric_limits<double>::quiet_NaN());
+            previous = begin;
+            continue;
+        }
+        int indices[2] = {std::min(min_index, max_index), std::max(min_index, max_index)};
+        for(int index : indices) {
+            if(index != previous) {
+                out_keys.push_back(keys[index]);
+                out_values.push_back(m_values[index]);
+                previous = index;
+            }
+        }
+    }
+    if(previous != last - 1) {
+        out_keys.push_back(keys[last - 1]);
+        out_values.push_back(m_values[last - 1]);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef MINMAXPYRAMID_H
+#define MINMAXPYRAMID_H
+
+#include <cstddef>
+#include <vector>
+
+// Min/max decimation of one data column for drawing wide windows. Level l
+// holds the index of the smallest and largest value of every aligned block
+// of base_block << l samples, so the extremes of any range are found by
+// combining O(log n) blocks. A decimated window keeps both extremes of each
+// output bucket in sample order, which keeps spikes and the autoscaled
+// limits exactly as in the full data. The same blocks answer range queries
+// for autoscaling without touching the samples of the window.
+class MinMaxPyramid
+{
+public:
+    MinMaxPyramid();
+
+    // values must stay valid for the lifetime of the pyramid
+    void build(const double *values, int count);
+    // use blocks built before, storageSize(count) indices as storage()
+    // hands them out, e.g. from a mapped file; both arrays must stay
+    // valid for the lifetime of the pyramid
+    void attach(const double *values, int count, const int *storage);
+
+    // the block indices of all levels, to be saved and attached again
+    const int* storage() const { return m_owned.empty() ? m_storage : m_owned.data(); }
+    static size_t storageSize(int count);
+
+    // keys/values of [first, last) reduced to at most about max_points
+    // points; windows that already fit are copied as they are. The output
+    // vectors are overwritten, reusing their capacity.
+    void decimate(const double *keys, int first, int last, int max_points,
+                  std::vector<double> &out_keys, std::vector<double> &out_values) const;
+
+    // smallest and largest non-NaN value of [first, last); false if
+    // there is none
+    bool range(int first, int last, double &min, double &max) const;
+
+private:
+    // indices of the smallest and largest non-NaN value in [begin, end),
+    // -1 if there is none
+    void extremes(int begin, int end, int &min_index, int &max_index) const;
+    void merge(int index, int &min_index, int &max_index) const;
+    // offsets into the storage and block counts of the levels for count
+    // samples; returns the indices needed
+    static size_t layout(int count, std::vector<size_t> *offsets, std::vector<int> *blocks);
+
+    static const int base_block = 8;
+
+    const double *m_values = nullptr;
+    int m_count = 0;
+    // all levels one after another, two indices per block: min, max.
+    // Built ones are owned, attached ones are not.
+    std::vector<int> m_owned;
+    const int *m_storage = nullptr;
+    std::vector<size_t> m_level_offsets;
+    std::vector<int> m_level_blocks;
+};
+
+#endif // MINMAXPYRAMID_H
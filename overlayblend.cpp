@@ -0,0 +1,154 @@
+#include "overlayblend.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define OVERLAYBLEND_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OVERLAYBLEND_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+typedef void (*RowKernel)(const uchar *color, const uchar *inverse_alpha, uchar *dst, int bytes);
+
+// x/255 rounded, exact for x <= 255*255
+inline uchar div255(unsigned x)
+{
+    return static_cast<uchar>((x + ((x + 128) >> 8) + 128) >> 8);
+}
+
+void blendRowScalar(const uchar *color, const uchar *inverse_alpha, uchar *dst, int bytes)
+{
+    for(int i = 0; i < bytes; ++i) {
+        unsigned value = color[i] + div255(dst[i]*unsigned(inverse_alpha[i]));
+        dst[i] = static_cast<uchar>(std::min(value, 255u));
+    }
+}
+
+#ifdef OVERLAYBLEND_AVX2
+__attribute__((target("avx2")))
+void blendRowAvx2(const uchar *color, const uchar *inverse_alpha, uchar *dst, int bytes)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i half = _mm256_set1_epi16(128);
+    int i = 0;
+    for(; i + 32 <= bytes; i += 32) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(inverse_alpha + i));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(color + i));
+
+        // unpack and pack both work per 128-bit lane, so the order holds
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(a, zero));
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(a, zero));
+        lo = _mm256_add_epi16(lo, half);
+        hi = _mm256_add_epi16(hi, half);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+        __m256i blended = _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), blended);
+    }
+    blendRowScalar(color + i, inverse_alpha + i, dst + i, bytes - i);
+}
+#endif
+
+#ifdef OVERLAYBLEND_NEON
+void blendRowNeon(const uchar *color, const uchar *inverse_alpha, uchar *dst, int bytes)
+{
+    int i = 0;
+    for(; i + 16 <= bytes; i += 16) {
+        uint8x16_t d = vld1q_u8(dst + i);
+        uint8x16_t a = vld1q_u8(inverse_alpha + i);
+        uint8x16_t c = vld1q_u8(color + i);
+
+        uint16x8_t lo = vmull_u8(vget_low_u8(d), vget_low_u8(a));
+        uint16x8_t hi = vmull_u8(vget_high_u8(d), vget_high_u8(a));
+        // (t + ((t + 128) >> 8) + 128) >> 8
+        uint8x8_t lo8 = vrshrn_n_u16(vrsraq_n_u16(lo, lo, 8), 8);
+        uint8x8_t hi8 = vrshrn_n_u16(vrsraq_n_u16(hi, hi, 8), 8);
+
+        vst1q_u8(dst + i, vqaddq_u8(vcombine_u8(lo8, hi8), c));
+    }
+    blendRowScalar(color + i, inverse_alpha + i, dst + i, bytes - i);
+}
+#endif
+
+RowKernel bestKernel()
+{
+#ifdef OVERLAYBLEND_AVX2
+    if(__builtin_cpu_supports("avx2")) {
+        return blendRowAvx2;
+    }
+#endif
+#ifdef OVERLAYBLEND_NEON
+    return blendRowNeon;
+#endif
+    return blendRowScalar;
+}
+
+void blendRows(RowKernel kernel, const cv::Mat &color, const cv::Mat &inverse_alpha, cv::Mat &dst)
+{
+    CV_Assert(color.type() == CV_8UC3 && inverse_alpha.type() == CV_8UC3 && dst.type() == CV_8UC3);
+    CV_Assert(color.size() == dst.size() && inverse_alpha.size() == dst.size());
+    int bytes = dst.cols*3;
+    for(int y = 0; y < dst.rows; ++y) {
+        kernel(color.ptr<uchar>(y), inverse_alpha.ptr<uchar>(y), dst.ptr<uchar>(y), bytes);
+    }
+}
+
+}
+
+void OverlayBlend::premultiply(const cv::Mat &plot, double opacity,
+                               cv::Mat &color, cv::Mat &inverse_alpha)
+{
+    CV_Assert(plot.type() == CV_8UC3);
+    color.create(plot.size(), CV_8UC3);
+    inverse_alpha.create(plot.size(), CV_8UC3);
+
+    const unsigned scale = static_cast<unsigned>(std::max(0.0, std::min(opacity, 1.0))*256 + 0.5);
+    for(int y = 0; y < plot.rows; ++y) {
+        const uchar *src = plot.ptr<uchar>(y);
+        uchar *c = color.ptr<uchar>(y);
+        uchar *a = inverse_alpha.ptr<uchar>(y);
+        for(int x = 0; x < plot.cols; ++x, src += 3, c += 3, a += 3) {
+            // pure white is transparent, any darker channel adds coverage
+            unsigned white = std::min(src[0], std::min(src[1], src[2]));
+            unsigned alpha = ((255 - white)*scale + 128) >> 8;
+            c[0] = static_cast<uchar>(((src[0] - white)*scale + 128) >> 8);
+            c[1] = static_cast<uchar>(((src[1] - white)*scale + 128) >> 8);
+            c[2] = static_cast<uchar>(((src[2] - white)*scale + 128) >> 8);
+            a[0] = a[1] = a[2] = static_cast<uchar>(255 - alpha);
+        }
+    }
+}
+
+void OverlayBlend::blend(const cv::Mat &color, const cv::Mat &inverse_alpha, cv::Mat &dst)
+{
+    static const RowKernel kernel = bestKernel();
+    blendRows(kernel, color, inverse_alpha, dst);
+}
+
+void OverlayBlend::blendScalar(const cv::Mat &color, const cv::Mat &inverse_alpha, cv::Mat &dst)
+{
+    blendRows(blendRowScalar, color, inverse_alpha, dst);
+}
+
+const char* OverlayBlend::kernelName()
+{
+    RowKernel kernel = bestKernel();
+#ifdef OVERLAYBLEND_AVX2
+    if(kernel == blendRowAvx2) {
+        return "avx2";
+    }
+#endif
+#ifdef OVERLAYBLEND_NEON
+    if(kernel == blendRowNeon) {
+        return "neon";
+    }
+#endif
+    return "scalar";
+}
@@ -0,0 +1,33 @@
+#ifndef OVERLAYBLEND_H
+#define OVERLAYBLEND_H
+
+#include <opencv2/core.hpp>
+
+// Blends the rendered plot over the video with a per-pixel alpha.
+//
+// CvPlot draws on white, so the plot is turned into a premultiplied
+// overlay by taking white back out: the alpha of a pixel is how far its
+// darkest channel is from white. The background becomes transparent while
+// lines, text and grid stay opaque. The frame is BGR, so instead of BGRA
+// the overlay keeps its inverse alpha repeated per channel; the blend is
+// then the same integer operation on every byte and runs 32 (AVX2) or 16
+// (NEON) bytes at a time.
+class OverlayBlend
+{
+public:
+    // plot: CV_8UC3 on white; opacity scales the whole overlay
+    // color and inverse_alpha are reallocated only if the size changes
+    static void premultiply(const cv::Mat &plot, double opacity,
+                            cv::Mat &color, cv::Mat &inverse_alpha);
+
+    // dst = color + dst*inverse_alpha/255, all CV_8UC3 of the same size
+    static void blend(const cv::Mat &color, const cv::Mat &inverse_alpha, cv::Mat &dst);
+
+    // the portable kernel, for comparison
+    static void blendScalar(const cv::Mat &color, const cv::Mat &inverse_alpha, cv::Mat &dst);
+
+    // "avx2", "neon" or "scalar"
+    static const char* kernelName();
+};
+
+#endif // OVERLAYBLEND_H
@@ -0,0 +1,185 @@
+#include "polylinerenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+PolylineRenderer::PolylineRenderer()
+{
+}
+
+void PolylineRenderer::setViewport(const cv::Rect &plot_rect, double x_min, double x_max, double y_min, double y_max)
+{
+    m_plot_rect = plot_rect;
+    // pixel centers of the first and last column and row sit on the limits
+    m_x_min = x_min;
+    m_x_scale = x_max != x_min ? (plot_rect.width - 1)/(x_max - x_min) : 0.0;
+    m_y_max = y_max;
+    m_y_scale = y_max != y_min ? (plot_rect.height - 1)/(y_max - y_min) : 0.0;
+}
+
+void PolylineRenderer::draw(cv::Mat &image, const double *keys, const double *values, int count,
+                            const cv::Scalar &color, double line_width)
+{
+    cv::Rect rect = m_plot_rect & cv::Rect(0, 0, image.cols, image.rows);
+    if(count < 2 || rect.area() <= 0 || m_x_scale == 0.0 || m_y_scale == 0.0) {
+        return;
+    }
+    cv::Mat plot = image(rect);
+    if(m_coverage.rows != plot.rows || m_coverage.cols != plot.cols) {
+        m_coverage = cv::Mat::zeros(plot.rows, plot.cols, CV_8UC1);
+        m_span_begin.assign(plot.rows, plot.cols);
+        m_span_end.assign(plot.rows, -1);
+    }
+    // where cv::polylines' anti-aliased edge is half covered: 0.7 pixels
+    // beyond (thickness + 1)/2 whole pixels for thick lines, and beyond the
+    // center line for a thickness of 1
+    const int thickness = std::max(1, static_cast<int>(std::lround(line_width)));
+    m_radius = (thickness > 1 ? (thickness + 1)/2 : 0) + 0.7;
+
+    // to pixels in one pass the compiler can vectorize; NaN stays NaN
+    m_x.resize(count);
+    m_y.resize(count);
+    double *x = m_x.data();
+    double *y = m_y.data();
+    const double x_offset = (rect.x - m_plot_rect.x) - m_x_min*m_x_scale;
+    const double y_offset = (rect.y - m_plot_rect.y) + m_y_max*m_y_scale;
+    const double x_scale = m_x_scale;
+    const double y_scale = -m_y_scale;
+    for(int i = 0; i < count; ++i) {
+        x[i] = keys[i]*x_scale + x_offset;
+        y[i] = values[i]*y_scale + y_offset;
+    }
+
+    m_dirty = cv::Rect();
+    for(int i = 1; i < count; ++i) {
+        // a point that is not finite ends the line
+        if(std::isfinite(x[i - 1]) && std::isfinite(y[i - 1]) && std::isfinite(x[i]) && std::isfinite(y[i])) {
+            segment(x[i - 1], y[i - 1], x[i], y[i]);
+        }
+    }
+    composite(plot, color);
+}
+
+void PolylineRenderer::segment(double x0, double y0, double x1, double y1)
+{
+    const int w = m_coverage.cols;
+    const int h = m_coverage.rows;
+    // pixel centers farther than this from the segment get no coverage
+    const double reach = m_radius + 0.5;
+
+    // Liang-Barsky against the plot area grown by reach, so clipped ends
+    // and their caps stay outside of it
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {x0 + reach, w - 1 + reach - x0, y0 + reach, h - 1 + reach - y0};
+    double t0 = 0.0;
+    double t1 = 1.0;
+    for(int k = 0; k < 4; ++k) {
+        if(p[k] == 0.0) {
+            if(q[k] < 0.0) {
+                return;
+            }
+            continue;
+        }
+        double t = q[k]/p[k];
+        if(p[k] < 0.0) {
+            t0 = std::max(t0, t);
+        }
+        else {
+            t1 = std::min(t1, t);
+        }
+        if(t0 > t1) {
+            return;
+        }
+    }
+    const double ax = x0 + t0*dx;
+    const double ay = y0 + t0*dy;
+    dx *= t1 - t0;
+    dy *= t1 - t0;
+    const double length2 = dx*dx + dy*dy;
+    const double length = std::sqrt(length2);
+
+    const int row_begin = std::max(0, static_cast<int>(std::ceil(std::min(ay, ay + dy) - reach)));
+    const int row_end = std::min(h - 1, static_cast<int>(std::floor(std::max(ay, ay + dy) + reach)));
+    const double column_low = std::min(ax, ax + dx) - reach;
+    const double column_high = std::max(ax, ax + dx) + reach;
+    if(row_begin > row_end) {
+        return;
+    }
+    int dirty_begin = w;
+    int dirty_end = -1;
+    for(int py = row_begin; py <= row_end; ++py) {
+        // only the columns within reach of the line through the segment
+        double from = column_low;
+        double to = column_high;
+        if(dy != 0.0) {
+            double center = ax + (py - ay)*dx/dy;
+            double half = reach*length/std::abs(dy);
+            from = std::max(from, center - half);
+            to = std::min(to, center + half);
+        }
+        const int begin = std::max(0, static_cast<int>(std::ceil(from)));
+        const int end = std::min(w - 1, static_cast<int>(std::floor(to)));
+        uchar *row = m_coverage.ptr<uchar>(py);
+        const double uy = py - ay;
+        for(int px = begin; px <= end; ++px) {
+            const double ux = px - ax;
+            double t = length2 > 0.0 ? (ux*dx + uy*dy)/length2 : 0.0;
+            t = std::min(std::max(t, 0.0), 1.0);
+            const double ex = ux - t*dx;
+            const double ey = uy - t*dy;
+            const double cover = reach - std::sqrt(ex*ex + ey*ey);
+            if(cover > 0.0) {
+                int c = cover >= 1.0 ? 255 : static_cast<int>(cover*255.0 + 0.5);
+                row[px] = static_cast<uchar>(std::max<int>(row[px], c));
+            }
+        }
+        dirty_begin = std::min(dirty_begin, begin);
+        dirty_end = std::max(dirty_end, end);
+        m_span_begin[py] = std::min(m_span_begin[py], begin);
+        m_span_end[py] = std::max(m_span_end[py], end);
+    }
+    if(dirty_end >= dirty_begin) {
+        cv::Rect dirty(dirty_begin, row_begin, dirty_end - dirty_begin + 1, row_end - row_begin + 1);
+        m_dirty = m_dirty.area() > 0 ? (m_dirty | dirty) : dirty;
+    }
+}
+
+void PolylineRenderer::composite(cv::Mat &plot, const cv::Scalar &color)
+{
+    if(m_dirty.area() <= 0) {
+        return;
+    }
+    int bgr[3];
+    for(int c = 0; c < 3; ++c) {
+        bgr[c] = std::min(std::max(static_cast<int>(std::lround(color[c])), 0), 255);
+    }
+    for(int y = m_dirty.y; y < m_dirty.y + m_dirty.height; ++y) {
+        uchar *mask = m_coverage.ptr<uchar>(y);
+        uchar *pixel = plot.ptr<uchar>(y);
+        const int end = m_span_end[y];
+        for(int x = m_span_begin[y]; x <= end; ++x) {
+            // a line crosses most rows only here and there
+            uint64_t empty;
+            if(x + 8 <= end + 1 && (std::memcpy(&empty, mask + x, 8), empty == 0)) {
+                x += 7;
+                continue;
+            }
+            const int a = mask[x];
+            if(a == 0) {
+                continue;
+            }
+            uchar *p = pixel + 3*x;
+            for(int c = 0; c < 3; ++c) {
+                p[c] = static_cast<uchar>((p[c]*(255 - a) + bgr[c]*a + 127)/255);
+            }
+            mask[x] = 0;
+        }
+        m_span_begin[y] = m_coverage.cols;
+        m_span_end[y] = -1;
+    }
+    m_dirty = cv::Rect();
+}
@@ -0,0 +1,56 @@
+#ifndef POLYLINERENDERER_H
+#define POLYLINERENDERER_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Draws data series as anti-aliased polylines of any width straight into
+// the plot area of a BGR image, in place of CvPlot's series rendering.
+//
+// Keys and values are mapped to pixels in one branch-free pass. Every
+// segment is clipped to the plot area and rasterized as a capsule: the
+// coverage of a pixel is how far its center lies inside the line's half
+// width, so joints are round and ends are capped, and a thickness gives
+// the weight cv::polylines with LINE_AA gives it. Coverage goes into a
+// mask as the maximum over the segments of a line, so overlapping segments
+// and spikes of decimated windows do not darken where they meet, and the
+// color is blended once per pixel, only along the covered spans of rows.
+class PolylineRenderer
+{
+public:
+    PolylineRenderer();
+
+    // data limits shown by plot_rect of the images drawn into
+    void setViewport(const cv::Rect &plot_rect, double x_min, double x_max, double y_min, double y_max);
+
+    // count points of keys against values onto image (CV_8UC3); NaN in
+    // either ends a line. line_width is a thickness as cv::polylines takes
+    // it and gives a line of the same weight.
+    void draw(cv::Mat &image, const double *keys, const double *values, int count,
+              const cv::Scalar &color, double line_width);
+
+private:
+    // coverage of the segment from (x0, y0) to (x1, y1) into m_coverage
+    void segment(double x0, double y0, double x1, double y1);
+    // blend color over the covered pixels and clear the mask again
+    void composite(cv::Mat &plot, const cv::Scalar &color);
+
+    cv::Rect m_plot_rect;
+    double m_x_min = 0.0;
+    double m_x_scale = 0.0;
+    double m_y_max = 0.0;
+    double m_y_scale = 0.0;
+    double m_radius = 0.5;
+
+    // pixel coordinates of the points, reused between calls
+    std::vector<double> m_x;
+    std::vector<double> m_y;
+    // coverage of the plot area; zero outside m_dirty and, per row, outside
+    // the columns from m_span_begin to m_span_end
+    cv::Mat m_coverage;
+    cv::Rect m_dirty;
+    std::vector<int> m_span_begin;
+    std::vector<int> m_span_end;
+};
+
+#endif // POLYLINERENDERER_H
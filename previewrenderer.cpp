@@ -0,0 +1,155 @@
+#include "previewrenderer.h"
+#include "stagetimings.h"
+
+#include <opencv2/imgproc.hpp>
+
+// settings that change the transformed frame under the graph
+static bool sameGeometry(const CompositorSettings &a, const CompositorSettings &b)
+{
+    return a.rotation == b.rotation && a.scale == b.scale
+            && a.crop == b.crop && a.output_size == b.output_size;
+}
+
+PreviewRenderer::PreviewRenderer()
+{
+    m_thread = std::thread(&PreviewRenderer::renderLoop, this);
+}
+
+PreviewRenderer::~PreviewRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+}
+
+void PreviewRenderer::setGraphData(const std::shared_ptr<const GraphData> &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_data = data;
+}
+
+void PreviewRenderer::setLiveSource(const std::shared_ptr<const LiveSource> &live)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_live = live;
+}
+
+void PreviewRenderer::request(const cv::Mat &source, int frame_index, double time_ms,
+                              const CompositorSettings &settings, bool new_frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // a request that has not started is replaced, not queued
+        new_frame = new_frame || (m_pending && m_request.new_frame);
+        m_request.source = source;
+        m_request.frame_index = frame_index;
+        m_request.time_ms = time_ms;
+        m_request.settings = settings;
+        m_request.new_frame = new_frame;
+        m_pending = true;
+    }
+    m_changed.notify_all();
+}
+
+void PreviewRenderer::cancel()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending = false;
+    m_request.source.release();
+    m_ready = false;
+    ++m_cancels;
+}
+
+bool PreviewRenderer::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_pending && !m_rendering && !m_ready;
+}
+
+bool PreviewRenderer::take(cv::Mat &background, cv::Mat &graph, cv::Mat &composited, Result &result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_ready) {
+        return false;
+    }
+    // the render thread writes only into m_work, so the buffers can be
+    // traded while it runs
+    result = m_done.result;
+    if(result.background_changed) {
+        cv::swap(m_done.background, background);
+        m_background_taken = m_done.background_serial;
+    }
+    cv::swap(m_done.graph, graph);
+    cv::swap(m_done.composited, composited);
+    m_ready = false;
+    return true;
+}
+
+void PreviewRenderer::renderLoop()
+{
+    while(true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]{ return m_stop || m_pending; });
+        if(m_stop) {
+            return;
+        }
+        Request request = m_request;
+        m_request.source.release();
+        m_pending = false;
+        m_rendering = true;
+        long long cancels = m_cancels;
+        if(request.new_frame || !sameGeometry(request.settings, m_compositor.settings())) {
+            ++m_background_serial;
+        }
+        // the background is drawn again until the UI took one of it
+        bool background = m_background_serial != m_background_taken;
+        m_work.background_serial = m_background_serial;
+        std::shared_ptr<const GraphData> data = m_data;
+        std::shared_ptr<const LiveSource> live = m_live;
+        lock.unlock();
+
+        m_compositor.setGraphData(data);
+        m_compositor.setLiveSource(live);
+        m_compositor.setSettings(request.settings);
+        render(request, background, m_work);
+
+        lock.lock();
+        m_rendering = false;
+        if(cancels == m_cancels) {
+            // a new frame nobody took is still new in the render after it
+            m_work.result.new_frame = m_work.result.new_frame || (m_ready && m_done.result.new_frame);
+            cv::swap(m_work.background, m_done.background);
+            cv::swap(m_work.graph, m_done.graph);
+            cv::swap(m_work.composited, m_done.composited);
+            std::swap(m_work.result, m_done.result);
+            std::swap(m_work.background_serial, m_done.background_serial);
+            m_ready = true;
+        }
+    }
+}
+
+void PreviewRenderer::render(const Request &request, bool background, Frame &frame)
+{
+    // the source stays as decoded for the next request
+    request.source.copyTo(frame.composited);
+    m_compositor.transform(frame.composited);
+
+    frame.result = Result();
+    frame.result.frame_index = request.frame_index;
+    frame.result.new_frame = request.new_frame;
+    if(background) {
+        StageTimings::Scope timing(StageTimings::Convert, request.frame_index);
+        cv::cvtColor(frame.composited, frame.background, cv::COLOR_BGR2BGRA);
+        frame.result.background_changed = true;
+    }
+
+    cv::Rect dirty = m_compositor.blend(frame.composited, request.frame_index, request.time_ms);
+    if(dirty.area() > 0) {
+        StageTimings::Scope timing(StageTimings::Convert, request.frame_index);
+        cv::cvtColor(frame.composited(dirty), frame.graph, cv::COLOR_BGR2BGRA);
+        frame.result.graph_rect = dirty;
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef PREVIEWRENDERER_H
+#define PREVIEWRENDERER_H
+
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "framecompositor.h"
+
+class LiveSource;
+
+// Composites the paused frame again on its own thread whenever a setting
+// changes. The decoded frame handed in is never written to, so every
+// render starts from the pristine frame. Only the newest request is kept:
+// a request replaces one that has not started yet, so dragging a slider
+// over a 4K frame renders as often as the thread keeps up and the UI
+// thread never waits for it.
+class PreviewRenderer
+{
+public:
+    struct Result
+    {
+        int frame_index = -1;
+        // a new frame, not the same one with other settings
+        bool new_frame = false;
+        // background was traded for the transformed frame without graph
+        bool background_changed = false;
+        // part of the frame graph holds; empty for none
+        cv::Rect graph_rect;
+    };
+
+    PreviewRenderer();
+    ~PreviewRenderer();
+
+    void setGraphData(const std::shared_ptr<const GraphData> &data);
+    void setLiveSource(const std::shared_ptr<const LiveSource> &live);
+
+    // render source, a decoded frame that must not be written to while it
+    // may be in use here, with settings. new_frame sticks to the request
+    // until it is rendered, even when newer requests replace it.
+    void request(const cv::Mat &source, int frame_index, double time_ms,
+                 const CompositorSettings &settings, bool new_frame);
+    // drop the waiting request and any result not taken yet, including
+    // the one being rendered
+    void cancel();
+    // nothing waiting, rendering or ready to take
+    bool isIdle() const;
+
+    // trades the newest render's buffers for the caller's, like
+    // FramePipeline::takeFrame: background gets BGRX pixels of the
+    // transformed frame if they changed since the last take, graph the
+    // BGRX pixels of the graph rect and composited the BGR frame with the
+    // graph. False if there is no new render.
+    bool take(cv::Mat &background, cv::Mat &graph, cv::Mat &composited, Result &result);
+
+private:
+    PreviewRenderer(const PreviewRenderer&) = delete;
+    PreviewRenderer& operator=(const PreviewRenderer&) = delete;
+
+    struct Request
+    {
+        cv::Mat source;
+        int frame_index = -1;
+        double time_ms = 0.0;
+        CompositorSettings settings;
+        bool new_frame = false;
+    };
+
+    // buffers of one render
+    struct Frame
+    {
+        cv::Mat background;
+        cv::Mat graph;
+        cv::Mat composited;
+        Result result;
+        long long background_serial = 0;
+    };
+
+    void renderLoop();
+    // background: convert the transformed frame for the UI as well
+    void render(const Request &request, bool background, Frame &frame);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    Request m_request;
+    bool m_pending = false;
+    bool m_rendering = false;
+    bool m_ready = false;
+    // counts new frames and geometries; the UI holds the background of
+    // m_background_taken
+    long long m_background_serial = 0;
+    long long m_background_taken = 0;
+    long long m_cancels = 0;
+    bool m_stop = false;
+    std::shared_ptr<const GraphData> m_data;
+    std::shared_ptr<const LiveSource> m_live;
+
+    // owned by the render thread
+    FrameCompositor m_compositor;
+    Frame m_work;
+    // the last render, published for take
+    Frame m_done;
+
+    std::thread m_thread;
+};
+
+#endif // PREVIEWRENDERER_H
@@ -0,0 +1,63 @@
+#include "samplering.h"
+
+#include <algorithm>
+#include <cstring>
+
+SampleRing::SampleRing(int columns, int capacity)
+    : m_columns(std::max(columns, 1))
+{
+    int size = 1;
+    while(size < capacity) {
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_samples.reset(new std::atomic<double>[static_cast<size_t>(size)*m_columns]);
+    m_head.store(0);
+}
+
+void SampleRing::push(const double *row)
+{
+    long long head = m_head.load(std::memory_order_relaxed);
+    std::atomic<double> *slot = m_samples.get() + (head & m_mask)*m_columns;
+    // the seqlock writer's fence: a reader that sees any of the samples
+    // below also sees the head published before them, so newest() drops
+    // the row it finds being overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    for(int c = 0; c < m_columns; ++c) {
+        slot[c].store(row[c], std::memory_order_relaxed);
+    }
+    // publishes the row to readers that see the new head
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+int SampleRing::newest(int max_rows, std::vector<double> &out) const
+{
+    long long head = m_head.load(std::memory_order_acquire);
+    long long start = std::max(head - std::min<long long>(std::max(max_rows, 0), capacity()), 0LL);
+    int rows = static_cast<int>(head - start);
+    out.resize(static_cast<size_t>(rows)*m_columns);
+    for(int r = 0; r < rows; ++r) {
+        const std::atomic<double> *slot = m_samples.get() + ((start + r) & m_mask)*m_columns;
+        for(int c = 0; c < m_columns; ++c) {
+            out[static_cast<size_t>(c)*rows + r] = slot[c].load(std::memory_order_relaxed);
+        }
+    }
+
+    // the producer may have written rows up to the head it published now
+    // and be in the middle of the next one; every row within capacity of
+    // that one may hold newer samples than the ones we meant to copy
+    std::atomic_thread_fence(std::memory_order_acquire);
+    long long now = m_head.load(std::memory_order_relaxed);
+    long long dropped = std::min<long long>(std::max(now + 1 - capacity() - start, 0LL), rows);
+    if(dropped > 0) {
+        int kept = rows - static_cast<int>(dropped);
+        for(int c = 0; c < m_columns; ++c) {
+            std::memmove(out.data() + static_cast<size_t>(c)*kept,
+                         out.data() + static_cast<size_t>(c)*rows + dropped,
+                         kept*sizeof(double));
+        }
+        rows = kept;
+        out.resize(static_cast<size_t>(rows)*m_columns);
+    }
+    return rows;
+}
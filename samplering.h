@@ -0,0 +1,43 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Fixed-size ring of rows of samples with a single producer. Readers copy
+// the newest rows without locking or waiting for the producer; the
+// producer never waits either and overwrites the oldest rows once the
+// ring is full.
+class SampleRing
+{
+public:
+    // capacity is rounded up to a power of two
+    SampleRing(int columns, int capacity);
+
+    int columnCount() const { return m_columns; }
+    int capacity() const { return m_mask + 1; }
+
+    // producer thread only; row holds columnCount() values
+    void push(const double *row);
+    // rows pushed so far
+    long long pushed() const { return m_head.load(std::memory_order_acquire); }
+
+    // copy up to max_rows of the newest rows, column-major, into out; any
+    // thread. Rows the producer overwrites while they are being copied
+    // are dropped, so fewer rows than available may be returned.
+    int newest(int max_rows, std::vector<double> &out) const;
+
+private:
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    int m_columns;
+    int m_mask;
+    // row-major; atomic so copying a row that is being written is not a
+    // data race, relaxed accesses compile to plain loads and stores
+    std::unique_ptr<std::atomic<double>[]> m_samples;
+    std::atomic<long long> m_head;
+};
+
+#endif // SAMPLERING_H
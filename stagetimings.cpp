@@ -0,0 +1,238 @@
+#include "stagetimings.h"
+
+#include <QSaveFile>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// small ids for the trace viewer instead of native thread handles
+int currentThreadId()
+{
+    static std::atomic<int> next_id(1);
+    thread_local int id = next_id++;
+    return id;
+}
+
+}
+
+StageTimings& StageTimings::instance()
+{
+    static StageTimings timings;
+    return timings;
+}
+
+StageTimings::StageTimings()
+    : m_trace_enabled(false)
+    , m_next_event(0)
+    , m_dropped(0)
+    , m_epoch_ns(now())
+{
+    for(Histogram &histogram : m_histograms) {
+        for(std::atomic<long long> &count : histogram.counts) {
+            count.store(0);
+        }
+        histogram.count.store(0);
+        histogram.total_ns.store(0);
+        histogram.max_ns.store(0);
+    }
+}
+
+const char* StageTimings::stageName(Stage stage)
+{
+    static const char *names[StageCount] = {
+        "decode", "rotate", "slice", "plot render", "blend", "convert", "encode"
+    };
+    return stage >= 0 && stage < StageCount ? names[stage] : "unknown";
+}
+
+int StageTimings::bucketFor(long long duration_ns)
+{
+    if(duration_ns < linear_buckets) {
+        return static_cast<int>(std::max(duration_ns, 0LL));
+    }
+    // duration_ns lies in [2^e, 2^(e+1)), split into 8 sub-buckets
+    int e = 4;
+    while(e < 43 && (duration_ns >> (e + 1)) != 0) {
+        ++e;
+    }
+    int sub = static_cast<int>((duration_ns >> (e - 3)) & 7);
+    return std::min(linear_buckets + (e - 4)*8 + sub, buckets - 1);
+}
+
+double StageTimings::bucketMs(int bucket)
+{
+    if(bucket < linear_buckets) {
+        return bucket/1e6;
+    }
+    int e = (bucket - linear_buckets)/8 + 4;
+    int sub = (bucket - linear_buckets)%8;
+    double width = std::ldexp(1.0, e - 3);
+    // middle of the bucket
+    return ((8 + sub)*width + width/2)/1e6;
+}
+
+void StageTimings::record(Stage stage, long long start_ns, long long duration_ns, int frame)
+{
+    Histogram &histogram = m_histograms[stage];
+    histogram.counts[bucketFor(duration_ns)].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.total_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+    long long max_ns = histogram.max_ns.load(std::memory_order_relaxed);
+    while(duration_ns > max_ns
+          && !histogram.max_ns.compare_exchange_weak(max_ns, duration_ns, std::memory_order_relaxed)) {
+    }
+
+    // acquire pairs with setTraceEnabled, so m_events is seen allocated
+    if(!m_trace_enabled.load(std::memory_order_acquire)) {
+        return;
+    }
+    long long index = m_next_event.fetch_add(1, std::memory_order_relaxed);
+    if(index >= trace_capacity) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event &event = m_events[index];
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_ns.store(duration_ns, std::memory_order_relaxed);
+    event.stage.store(stage, std::memory_order_relaxed);
+    event.thread.store(currentThreadId(), std::memory_order_relaxed);
+    event.frame.store(frame, std::memory_order_relaxed);
+    event.written.store(true, std::memory_order_release);
+}
+
+void StageTimings::setTraceEnabled(bool enabled)
+{
+    if(enabled && !m_events) {
+        m_events.reset(new Event[trace_capacity]);
+        for(int i = 0; i < trace_capacity; ++i) {
+            m_events[i].written.store(false, std::memory_order_relaxed);
+        }
+    }
+    m_trace_enabled.store(enabled, std::memory_order_release);
+}
+
+void StageTimings::reset()
+{
+    for(Histogram &histogram : m_histograms) {
+        for(std::atomic<long long> &count : histogram.counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.total_ns.store(0, std::memory_order_relaxed);
+        histogram.max_ns.store(0, std::memory_order_relaxed);
+    }
+    if(m_events) {
+        long long used = std::min<long long>(m_next_event.load(), trace_capacity);
+        for(long long i = 0; i < used; ++i) {
+            m_events[i].written.store(false, std::memory_order_relaxed);
+        }
+    }
+    m_next_event.store(0);
+    m_dropped.store(0);
+    m_epoch_ns.store(now());
+}
+
+StageTimings::Summary StageTimings::summary(Stage stage) const
+{
+    const Histogram &histogram = m_histograms[stage];
+    Summary summary;
+    // bucket counts are summed rather than read from count, so the
+    // percentiles stay consistent with calls recorded meanwhile
+    long long counts[buckets];
+    for(int b = 0; b < buckets; ++b) {
+        counts[b] = histogram.counts[b].load(std::memory_order_relaxed);
+        summary.count += counts[b];
+    }
+    if(summary.count == 0) {
+        return summary;
+    }
+    summary.total_ms = histogram.total_ns.load(std::memory_order_relaxed)/1e6;
+    summary.mean_ms = summary.total_ms/summary.count;
+    summary.max_ms = histogram.max_ns.load(std::memory_order_relaxed)/1e6;
+
+    auto percentile = [&](double q) {
+        long long target = std::max(1LL, static_cast<long long>(std::ceil(q*summary.count)));
+        long long seen = 0;
+        for(int b = 0; b < buckets; ++b) {
+            seen += counts[b];
+            if(seen >= target) {
+                return std::min(bucketMs(b), summary.max_ms);
+            }
+        }
+        return summary.max_ms;
+    };
+    summary.p50_ms = percentile(0.50);
+    summary.p99_ms = percentile(0.99);
+    return summary;
+}
+
+QString StageTimings::report() const
+{
+    QStringList lines;
+    lines << QString("%1 %2 %3 %4 %5")
+             .arg("stage", -12).arg("p50 ms", 8).arg("p99 ms", 8).arg("max ms", 8).arg("calls", 8);
+    for(int stage = 0; stage < StageCount; ++stage) {
+        Summary s = summary(static_cast<Stage>(stage));
+        lines << QString("%1 %2 %3 %4 %5")
+                 .arg(stageName(static_cast<Stage>(stage)), -12)
+                 .arg(s.p50_ms, 8, 'f', 2).arg(s.p99_ms, 8, 'f', 2).arg(s.max_ms, 8, 'f', 2)
+                 .arg(s.count, 8);
+    }
+    return lines.join("\n");
+}
+
+bool StageTimings::writeCsv(const QString &file_name) const
+{
+    QSaveFile file(file_name);
+    if(!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    file.write("stage,count,total_ms,mean_ms,p50_ms,p99_ms,max_ms\n");
+    for(int stage = 0; stage < StageCount; ++stage) {
+        Summary s = summary(static_cast<Stage>(stage));
+        file.write(QString("%1,%2,%3,%4,%5,%6,%7\n")
+                   .arg(stageName(static_cast<Stage>(stage))).arg(s.count)
+                   .arg(s.total_ms, 0, 'f', 4).arg(s.mean_ms, 0, 'f', 4)
+                   .arg(s.p50_ms, 0, 'f', 4).arg(s.p99_ms, 0, 'f', 4).arg(s.max_ms, 0, 'f', 4)
+                   .toUtf8());
+    }
+    return file.commit();
+}
+
+bool StageTimings::writeTrace(const QString &file_name) const
+{
+    QSaveFile file(file_name);
+    if(!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    long long epoch_ns = m_epoch_ns.load();
+    long long used = m_events ? std::min<long long>(m_next_event.load(), trace_capacity) : 0;
+    bool first = true;
+    for(long long i = 0; i < used; ++i) {
+        const Event &event = m_events[i];
+        // reserved by a call that has not finished writing it
+        if(!event.written.load(std::memory_order_acquire)) {
+            continue;
+        }
+        int frame = event.frame.load(std::memory_order_relaxed);
+        // timestamps in µs
+        QString line = QString("%1{\"name\":\"%2\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%3,"
+                               "\"ts\":%4,\"dur\":%5")
+                .arg(first ? "" : ",\n")
+                .arg(stageName(static_cast<Stage>(event.stage.load(std::memory_order_relaxed))))
+                .arg(event.thread.load(std::memory_order_relaxed))
+                .arg((event.start_ns.load(std::memory_order_relaxed) - epoch_ns)/1e3, 0, 'f', 3)
+                .arg(event.duration_ns.load(std::memory_order_relaxed)/1e3, 0, 'f', 3);
+        if(frame >= 0) {
+            line += QString(",\"args\":{\"frame\":%1}").arg(frame);
+        }
+        line += "}";
+        file.write(line.toUtf8());
+        first = false;
+    }
+    file.write("\n]}\n");
+    return file.commit();
+}
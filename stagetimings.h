@@ -0,0 +1,132 @@
+#ifndef STAGETIMINGS_H
+#define STAGETIMINGS_H
+
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// How long each stage of getting a frame on screen or into a file takes,
+// recorded from any thread without locks. Every stage has a histogram of
+// durations with log-spaced buckets (about 12% wide), good for p50/p99 of
+// a run. When tracing is on, every timed call is also kept as an event
+// for the Chrome trace viewer (chrome://tracing, Perfetto) until the
+// event buffer is full.
+class StageTimings
+{
+public:
+    enum Stage
+    {
+        Decode,         // grab and retrieve from the capture
+        Rotate,         // rotate and scale
+        Slice,          // data window of every series
+        PlotRender,     // axes and series into the graph image
+        Blend,          // graph over the frame
+        Convert,        // BGR to the BGRX view format
+        Encode,         // VideoWriter::write
+        StageCount
+    };
+
+    struct Summary
+    {
+        long long count = 0;
+        double total_ms = 0.0;
+        double mean_ms = 0.0;
+        double p50_ms = 0.0;
+        double p99_ms = 0.0;
+        double max_ms = 0.0;
+    };
+
+    // times the scope it lives in
+    class Scope
+    {
+    public:
+        explicit Scope(Stage stage, int frame = -1)
+            : m_stage(stage), m_frame(frame), m_start(StageTimings::now())
+        {
+        }
+        ~Scope()
+        {
+            StageTimings::instance().record(m_stage, m_start, StageTimings::now() - m_start, m_frame);
+        }
+
+    private:
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        Stage m_stage;
+        int m_frame;
+        long long m_start;
+    };
+
+    // shared by every thread of the process
+    static StageTimings& instance();
+
+    static const char* stageName(Stage stage);
+    // ns on a monotonic clock
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(Stage stage, long long start_ns, long long duration_ns, int frame = -1);
+
+    // the event buffer is allocated the first time tracing is enabled;
+    // always switch it from the same thread
+    void setTraceEnabled(bool enabled);
+    bool isTraceEnabled() const { return m_trace_enabled.load(std::memory_order_relaxed); }
+    long long droppedEvents() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // start a new run; calls racing with it may land in either run
+    void reset();
+
+    Summary summary(Stage stage) const;
+    // one line per stage, for an overlay
+    QString report() const;
+
+    // stage,count,total_ms,mean_ms,p50_ms,p99_ms,max_ms
+    bool writeCsv(const QString &file_name) const;
+    // Trace Event Format, one complete event per timed call
+    bool writeTrace(const QString &file_name) const;
+
+private:
+    StageTimings();
+    StageTimings(const StageTimings&) = delete;
+    StageTimings& operator=(const StageTimings&) = delete;
+
+    static int bucketFor(long long duration_ns);
+    static double bucketMs(int bucket);
+
+    // durations below 16 ns get a bucket each, longer ones 8 per power of two
+    static const int linear_buckets = 16;
+    static const int buckets = linear_buckets + 8*40;
+
+    struct Histogram
+    {
+        std::atomic<long long> counts[buckets];
+        std::atomic<long long> count;
+        std::atomic<long long> total_ns;
+        std::atomic<long long> max_ns;
+    };
+    Histogram m_histograms[StageCount];
+
+    struct Event
+    {
+        std::atomic<long long> start_ns;
+        std::atomic<long long> duration_ns;
+        std::atomic<int> stage;
+        std::atomic<int> thread;
+        std::atomic<int> frame;
+        std::atomic<bool> written;
+    };
+    static const int trace_capacity = 1 << 18;
+    std::unique_ptr<Event[]> m_events;
+    std::atomic<bool> m_trace_enabled;
+    std::atomic<long long> m_next_event;
+    std::atomic<long long> m_dropped;
+    // trace timestamps count from here
+    std::atomic<long long> m_epoch_ns;
+};
+
+#endif // STAGETIMINGS_H
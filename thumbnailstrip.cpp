@@ -0,0 +1,263 @@
+#include "thumbnailstrip.h"
+#include "keyframeindex.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDebug>
+#include <QtGlobal>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+#if defined(Q_OS_MACOS)
+#include <pthread.h>
+#elif defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char strip_magic[8] = {'C','M','P','T','H','M','B','\0'};
+const quint32 strip_version = 1;
+
+// native byte order, like the keyframe index
+struct StripHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 count;          // slots, one qint32 frame each, then their pixels
+    qint64 video_size;
+    qint64 video_modified;  // ms since epoch
+    qint32 width;
+    qint32 height;          // BGR pixels per slot, rows packed
+};
+
+// below the UI, the compositing workers and the encoder
+void lowerThreadPriority()
+{
+#if defined(Q_OS_MACOS)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined(Q_OS_LINUX)
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
+}
+
+ThumbnailStrip::ThumbnailStrip()
+    : m_cancel(false)
+{
+}
+
+ThumbnailStrip::~ThumbnailStrip()
+{
+    close();
+}
+
+QString ThumbnailStrip::cacheFileName(const QString &video_file)
+{
+    return video_file + ".thumbs";
+}
+
+void ThumbnailStrip::open(const QString &video_file, const KeyframeIndex &index, int count, int height)
+{
+    close();
+    m_index = &index;
+    m_height = std::max(height, 1);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images.assign(std::max(count, 1), cv::Mat());
+        m_frames.assign(m_images.size(), -1);
+    }
+    if(loadFile(video_file)) {
+        return;
+    }
+    m_cancel = false;
+    m_thread = std::thread(&ThumbnailStrip::build, this, video_file);
+}
+
+void ThumbnailStrip::close()
+{
+    m_cancel = true;
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_index = nullptr;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_images.clear();
+    m_frames.clear();
+    m_ready = 0;
+}
+
+int ThumbnailStrip::count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_frames.size());
+}
+
+int ThumbnailStrip::readyCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ready;
+}
+
+bool ThumbnailStrip::thumbnail(int slot, cv::Mat &image, int &frame) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(slot < 0 || slot >= static_cast<int>(m_frames.size()) || m_frames[slot] < 0) {
+        return false;
+    }
+    // thumbnails are never written to once decoded
+    image = m_images[slot];
+    frame = m_frames[slot];
+    return true;
+}
+
+void ThumbnailStrip::build(const QString &video_file)
+{
+    lowerThreadPriority();
+    // the slots are placed by the exact frame count and keyframes
+    while(!m_cancel && !m_index->isReady()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    int frames = m_index->frameCount();
+    if(m_cancel || frames <= 0) {
+        return;
+    }
+
+    cv::VideoCapture capture;
+    if(!capture.open(video_file.toStdString())) {
+        qDebug() << "unable to open" << video_file << "for thumbnails";
+        return;
+    }
+    // OpenCV cannot decode at a lower resolution; frames are shrunk after
+    double frame_w = capture.get(cv::CAP_PROP_FRAME_WIDTH);
+    double frame_h = capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+    cv::Size size(std::max(1, static_cast<int>(m_height*frame_w/std::max(frame_h, 1.0) + 0.5)), m_height);
+
+    const int count = static_cast<int>(m_images.size());
+    int stride = 1;
+    while(stride*2 < count) {
+        stride *= 2;
+    }
+    // in short videos several slots land on the same keyframe
+    std::map<int, cv::Mat> decoded;
+    cv::Mat frame;
+    for(; stride >= 1; stride /= 2) {
+        for(int slot = 0; slot < count; slot += stride) {
+            if(m_cancel) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(m_frames[slot] >= 0) {
+                    continue;
+                }
+            }
+            int target = static_cast<int>(static_cast<long long>(slot)*frames/count);
+            int keyframe = m_index->keyframeBefore(target);
+            if(keyframe < 0) {
+                // no keyframe flags: the backend seeks as close as it can
+                keyframe = target;
+            }
+            cv::Mat &image = decoded[keyframe];
+            if(image.empty()) {
+                capture.set(cv::CAP_PROP_POS_FRAMES, keyframe);
+                if(!capture.read(frame) || frame.empty()) {
+                    decoded.erase(keyframe);
+                    continue;
+                }
+                cv::resize(frame, image, size, 0, 0, cv::INTER_AREA);
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_images[slot] = image;
+            m_frames[slot] = keyframe;
+            ++m_ready;
+        }
+    }
+
+    // a strip with holes is built again next time
+    if(readyCount() == count && !saveFile(video_file)) {
+        qDebug() << "unable to write thumbnails for" << video_file;
+    }
+}
+
+bool ThumbnailStrip::saveFile(const QString &video_file) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_images.empty()) {
+        return false;
+    }
+    QFileInfo video_info(video_file);
+    StripHeader header;
+    std::memcpy(header.magic, strip_magic, sizeof(strip_magic));
+    header.version = strip_version;
+    header.count = static_cast<quint32>(m_images.size());
+    header.video_size = video_info.size();
+    header.video_modified = video_info.lastModified().toMSecsSinceEpoch();
+    header.width = m_images.front().cols;
+    header.height = m_images.front().rows;
+
+    QSaveFile file(cacheFileName(video_file));
+    if(!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    std::vector<qint32> frames(m_frames.begin(), m_frames.end());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(StripHeader));
+    file.write(reinterpret_cast<const char*>(frames.data()), frames.size()*sizeof(qint32));
+    for(const cv::Mat &image : m_images) {
+        for(int y = 0; y < image.rows; ++y) {
+            file.write(image.ptr<char>(y), image.cols*3);
+        }
+    }
+    return file.commit();
+}
+
+bool ThumbnailStrip::loadFile(const QString &video_file)
+{
+    QFileInfo video_info(video_file);
+    QFile file(cacheFileName(video_file));
+    if(!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = file.readAll();
+    if(data.size() < static_cast<int>(sizeof(StripHeader))) {
+        return false;
+    }
+    StripHeader header;
+    std::memcpy(&header, data.constData(), sizeof(StripHeader));
+    qint64 image_bytes = qint64(header.width)*header.height*3;
+    bool valid = std::memcmp(header.magic, strip_magic, sizeof(strip_magic)) == 0
+            && header.version == strip_version
+            && header.video_size == video_info.size()
+            && header.video_modified == video_info.lastModified().toMSecsSinceEpoch()
+            && header.count == m_images.size() && header.height == m_height && header.width > 0
+            && qint64(sizeof(StripHeader)) + header.count*(qint64(sizeof(qint32)) + image_bytes) == data.size();
+    if(!valid) {
+        // stale, or of another slot count or height: build it again
+        return false;
+    }
+
+    const char *pos = data.constData() + sizeof(StripHeader);
+    std::vector<qint32> frames(header.count);
+    std::memcpy(frames.data(), pos, frames.size()*sizeof(qint32));
+    pos += frames.size()*sizeof(qint32);
+    std::vector<cv::Mat> images(header.count);
+    for(cv::Mat &image : images) {
+        image.create(header.height, header.width, CV_8UC3);
+        std::memcpy(image.data, pos, image_bytes);
+        pos += image_bytes;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_images.swap(images);
+    m_frames.assign(frames.begin(), frames.end());
+    m_ready = static_cast<int>(m_frames.size());
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef THUMBNAILSTRIP_H
+#define THUMBNAILSTRIP_H
+
+#include <opencv2/core.hpp>
+#include <QString>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class KeyframeIndex;
+
+// Small frames spread evenly over a video for the timeline, decoded on a
+// low-priority thread once the keyframe index is ready and cached next to
+// the video (<file>.thumbs). Every slot shows the last keyframe before
+// its position, so a thumbnail costs one seek and one decode however long
+// the GOP. Slots fill coarse to fine, so the whole length is covered long
+// before every slot is done.
+class ThumbnailStrip
+{
+public:
+    ThumbnailStrip();
+    ~ThumbnailStrip();
+
+    // load the cached strip or start filling count slots of thumbnails
+    // height pixels high; index must stay open until close()
+    void open(const QString &video_file, const KeyframeIndex &index, int count = 160, int height = 64);
+    // stops a running build
+    void close();
+
+    int count() const;
+    // slots decoded so far
+    int readyCount() const;
+    // BGR thumbnail of slot and the frame it shows; false until decoded
+    bool thumbnail(int slot, cv::Mat &image, int &frame) const;
+
+    static QString cacheFileName(const QString &video_file);
+
+private:
+    void build(const QString &video_file);
+    bool loadFile(const QString &video_file);
+    bool saveFile(const QString &video_file) const;
+
+    const KeyframeIndex *m_index = nullptr;
+    int m_height = 64;
+
+    mutable std::mutex m_mutex;
+    std::vector<cv::Mat> m_images;
+    std::vector<int> m_frames;      // -1 until decoded
+    int m_ready = 0;
+
+    std::thread m_thread;
+    std::atomic<bool> m_cancel;
+};
+
+#endif // THUMBNAILSTRIP_H
@@ -0,0 +1,316 @@
+#include "timelinewidget.h"
+#include "thumbnailstrip.h"
+
+#include <QPainter>
+#include <QMouseEvent>
+#include <QTimer>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// true if both settings map frames to the same rows and draw the same
+// columns in the same colors
+static bool sameSparkline(const CompositorSettings &a, const CompositorSettings &b)
+{
+    if(a.series.size() != b.series.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < a.series.size(); ++i) {
+        if(a.series[i].column != b.series[i].column || a.series[i].color != b.series[i].color) {
+            return false;
+        }
+    }
+    return a.x_offset == b.x_offset && a.x_rate == b.x_rate && a.x_window == b.x_window
+            && a.fps == b.fps && a.align_timestamps == b.align_timestamps
+            && a.key_offset == b.key_offset && a.key_rate == b.key_rate && a.drift_ppm == b.drift_ppm;
+}
+
+TimelineWidget::TimelineWidget(QWidget *parent)
+    : QWidget(parent)
+    , m_poll(new QTimer(this))
+{
+    m_poll->setInterval(500);
+    connect(m_poll, &QTimer::timeout, this, &TimelineWidget::pollThumbnails);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+}
+
+QSize TimelineWidget::sizeHint() const
+{
+    return QSize(400, 96);
+}
+
+QSize TimelineWidget::minimumSizeHint() const
+{
+    return QSize(100, 96);
+}
+
+void TimelineWidget::setThumbnails(const ThumbnailStrip *strip)
+{
+    m_strip = strip;
+    m_thumbnails.clear();
+    if(m_strip) {
+        m_poll->start();
+        pollThumbnails();
+    }
+    else {
+        m_poll->stop();
+    }
+    update();
+}
+
+void TimelineWidget::setFrameCount(int frames)
+{
+    if(frames == m_frame_count) {
+        return;
+    }
+    m_frame_count = frames;
+    updateSparkline();
+}
+
+void TimelineWidget::setCurrentFrame(int frame)
+{
+    if(frame == m_current_frame) {
+        return;
+    }
+    m_current_frame = frame;
+    update();
+}
+
+void TimelineWidget::setGraph(const std::shared_ptr<const GraphData> &data, const CompositorSettings &settings)
+{
+    if(data == m_data && sameSparkline(settings, m_settings)) {
+        return;
+    }
+    m_data = data;
+    m_settings = settings;
+    updateSparkline();
+}
+
+int TimelineWidget::frameAt(int x) const
+{
+    if(m_frame_count <= 0 || width() <= 0) {
+        return 0;
+    }
+    long long frame = static_cast<long long>(std::max(x, 0))*m_frame_count/width();
+    return static_cast<int>(std::min<long long>(frame, m_frame_count - 1));
+}
+
+int TimelineWidget::xAt(int frame) const
+{
+    if(m_frame_count <= 0) {
+        return 0;
+    }
+    return static_cast<int>(static_cast<long long>(frame)*width()/m_frame_count);
+}
+
+int TimelineWidget::slotNear(int frame) const
+{
+    int count = static_cast<int>(m_thumbnails.size());
+    if(count == 0 || m_frame_count <= 0) {
+        return -1;
+    }
+    int slot = std::min(count - 1, static_cast<int>(static_cast<long long>(frame)*count/m_frame_count));
+    for(int d = 0; d < count; ++d) {
+        if(slot - d >= 0 && !m_thumbnails[slot - d].isNull()) {
+            return slot - d;
+        }
+        if(slot + d < count && !m_thumbnails[slot + d].isNull()) {
+            return slot + d;
+        }
+    }
+    return -1;
+}
+
+void TimelineWidget::pollThumbnails()
+{
+    if(!m_strip) {
+        m_poll->stop();
+        return;
+    }
+    int count = m_strip->count();
+    if(static_cast<int>(m_thumbnails.size()) != count) {
+        m_thumbnails.assign(count, QImage());
+    }
+    bool changed = false;
+    for(int slot = 0; slot < count; ++slot) {
+        cv::Mat image;
+        int frame = -1;
+        if(m_thumbnails[slot].isNull() && m_strip->thumbnail(slot, image, frame)) {
+            // a deep copy in RGB order, painted as is
+            m_thumbnails[slot] = QImage(image.data, image.cols, image.rows, static_cast<int>(image.step),
+                                        QImage::Format_RGB888).rgbSwapped();
+            changed = true;
+        }
+    }
+    if(count > 0 && m_strip->readyCount() == count) {
+        m_poll->stop();
+    }
+    if(changed) {
+        update();
+    }
+}
+
+void TimelineWidget::updateSparkline()
+{
+    m_low.clear();
+    m_high.clear();
+    m_min = 0.0;
+    m_max = 0.0;
+    const int w = width();
+    if(!m_data || m_data->count() == 0 || m_frame_count <= 0 || w <= 0) {
+        update();
+        return;
+    }
+
+    // each pixel column gets the rows that enter the window while its
+    // frames are shown, the newest rows of the plot
+    FrameCompositor compositor;
+    compositor.setSettings(m_settings);
+    compositor.setGraphData(m_data);
+    const int rows = m_data->count();
+    std::vector<int> ends(w + 1);
+    for(int x = 0; x <= w; ++x) {
+        int frame = static_cast<int>(static_cast<long long>(x)*m_frame_count/w);
+        long long end = static_cast<long long>(compositor.windowStart(frame, std::numeric_limits<double>::quiet_NaN()))
+                + m_settings.x_window;
+        ends[x] = static_cast<int>(std::max(0LL, std::min<long long>(end, rows)));
+    }
+
+    bool found = false;
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for(const SeriesStyle &style : m_settings.series) {
+        std::vector<float> low(w, nan);
+        std::vector<float> high(w, nan);
+        if(style.column > 0 && style.column < m_data->columnCount()) {
+            for(int x = 0; x < w; ++x) {
+                // frames before the data starts or after it ended
+                if(ends[x] >= rows || ends[x + 1] <= 0) {
+                    continue;
+                }
+                int first = ends[x];
+                int last = std::max(ends[x + 1], first + 1);
+                double lo = 0.0;
+                double hi = 0.0;
+                // O(log n) per column from the column's pyramid
+                if(m_data->range(style.column, first, last, lo, hi)) {
+                    low[x] = static_cast<float>(lo);
+                    high[x] = static_cast<float>(hi);
+                    m_min = found ? std::min(m_min, lo) : lo;
+                    m_max = found ? std::max(m_max, hi) : hi;
+                    found = true;
+                }
+            }
+        }
+        m_low.push_back(low);
+        m_high.push_back(high);
+    }
+    update();
+}
+
+void TimelineWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    updateSparkline();
+}
+
+void TimelineWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), QColor(30, 30, 30));
+    const int w = width();
+    const int strip_height = height()*3/5;
+    const QRect spark(0, strip_height, w, height() - strip_height);
+
+    // cells as wide as a thumbnail at this height, each showing the
+    // thumbnail closest to its middle
+    int first_slot = slotNear(0);
+    if(first_slot >= 0) {
+        const QImage &first = m_thumbnails[first_slot];
+        int cell_width = std::max(8, strip_height*first.width()/std::max(first.height(), 1));
+        int cells = std::max(1, (w + cell_width - 1)/cell_width);
+        for(int c = 0; c < cells; ++c) {
+            int x0 = c*w/cells;
+            int x1 = (c + 1)*w/cells;
+            int slot = slotNear(frameAt((x0 + x1)/2));
+            painter.drawImage(QRect(x0, 0, x1 - x0, strip_height), m_thumbnails[slot]);
+        }
+    }
+
+    // extremes per pixel column, scaled to the whole file
+    if(m_max > m_min) {
+        const double scale = (spark.height() - 3)/(m_max - m_min);
+        for(size_t s = 0; s < m_low.size(); ++s) {
+            const cv::Scalar &bgr = m_settings.series[s].color;
+            painter.setPen(QColor(static_cast<int>(bgr[2]), static_cast<int>(bgr[1]), static_cast<int>(bgr[0])));
+            QVector<QLine> lines;
+            lines.reserve(w);
+            for(int x = 0; x < static_cast<int>(m_low[s].size()); ++x) {
+                if(std::isnan(m_low[s][x])) {
+                    continue;
+                }
+                int y0 = spark.bottom() - 1 - static_cast<int>((m_low[s][x] - m_min)*scale);
+                int y1 = spark.bottom() - 1 - static_cast<int>((m_high[s][x] - m_min)*scale);
+                lines.append(QLine(x, y0, x, y1));
+            }
+            painter.drawLines(lines);
+        }
+    }
+
+    if(m_current_frame >= 0 && m_frame_count > 0) {
+        int x = xAt(m_current_frame);
+        painter.setPen(QPen(QColor(230, 40, 40), 2));
+        painter.drawLine(x, 0, x, height());
+    }
+
+    if(m_drag_frame >= 0) {
+        int x = xAt(m_drag_frame);
+        painter.setPen(QPen(QColor(250, 210, 40), 2));
+        painter.drawLine(x, 0, x, height());
+        // the thumbnail under the mouse over the whole height
+        int slot = slotNear(m_drag_frame);
+        if(slot >= 0) {
+            const QImage &image = m_thumbnails[slot];
+            int h = height() - 4;
+            int tw = h*image.width()/std::max(image.height(), 1);
+            int tx = std::max(2, std::min(x - tw/2, w - tw - 2));
+            QRect target(tx, 2, tw, h);
+            painter.drawImage(target, image);
+            painter.drawRect(target);
+            painter.drawText(target.adjusted(4, 2, -4, -2), Qt::AlignLeft | Qt::AlignBottom,
+                             QString::number(m_drag_frame + 1));
+        }
+    }
+}
+
+void TimelineWidget::mousePressEvent(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton || m_frame_count <= 0) {
+        QWidget::mousePressEvent(event);
+        return;
+    }
+    m_drag_frame = frameAt(event->pos().x());
+    update();
+}
+
+void TimelineWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if(m_drag_frame < 0) {
+        QWidget::mouseMoveEvent(event);
+        return;
+    }
+    m_drag_frame = frameAt(event->pos().x());
+    update();
+}
+
+void TimelineWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton || m_drag_frame < 0) {
+        QWidget::mouseReleaseEvent(event);
+        return;
+    }
+    int frame = m_drag_frame;
+    m_drag_frame = -1;
+    update();
+    emit frameRequested(frame);
+}
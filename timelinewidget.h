@@ -0,0 +1,75 @@
+#ifndef TIMELINEWIDGET_H
+#define TIMELINEWIDGET_H
+
+#include <QWidget>
+#include <QImage>
+#include <memory>
+#include <vector>
+
+#include "framecompositor.h"
+
+class QTimer;
+class ThumbnailStrip;
+
+// The whole video at a glance: a row of thumbnails over a sparkline of
+// the graph data, with the current frame marked. Clicking or dragging
+// picks a frame; while the button is down only the thumbnail nearest the
+// mouse is shown large, and the frame is requested on release, so
+// scrubbing through hours of video does not decode full frames.
+class TimelineWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TimelineWidget(QWidget *parent = nullptr);
+
+    // thumbnails are picked up as the strip fills; strip must stay alive
+    // until it is replaced
+    void setThumbnails(const ThumbnailStrip *strip);
+    void setFrameCount(int frames);
+    void setCurrentFrame(int frame);
+    // per frame, the rows of data that enter the plot's window with it,
+    // as extremes per pixel column from the pyramids of data
+    void setGraph(const std::shared_ptr<const GraphData> &data, const CompositorSettings &settings);
+
+    QSize sizeHint() const override;
+    QSize minimumSizeHint() const override;
+
+signals:
+    void frameRequested(int frame);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
+private:
+    int frameAt(int x) const;
+    int xAt(int frame) const;
+    // the decoded slot closest to frame, -1 if none yet
+    int slotNear(int frame) const;
+    void pollThumbnails();
+    void updateSparkline();
+
+    const ThumbnailStrip *m_strip = nullptr;
+    QTimer *m_poll;
+    // slots converted for painting; null until decoded
+    std::vector<QImage> m_thumbnails;
+
+    int m_frame_count = 0;
+    int m_current_frame = -1;
+    // frame under the mouse while a button is down, -1 otherwise
+    int m_drag_frame = -1;
+
+    std::shared_ptr<const GraphData> m_data;
+    CompositorSettings m_settings;
+    // per series and pixel column; NaN where the rows have no numbers
+    std::vector<std::vector<float>> m_low;
+    std::vector<std::vector<float>> m_high;
+    double m_min = 0.0;
+    double m_max = 0.0;
+};
+
+#endif // TIMELINEWIDGET_H
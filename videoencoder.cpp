@@ -0,0 +1,239 @@
+#include "videoencoder.h"
+#include "videoformat.h"
+#include "stagetimings.h"
+
+#include <QSettings>
+#include <QDebug>
+#include <QtGlobal>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// OpenCV's FFmpeg backend reads codec options for every writer it opens
+// from this variable as "key;value|key;value"
+const char writer_options_variable[] = "OPENCV_FFMPEG_WRITER_OPTIONS";
+std::mutex writer_options_mutex;
+
+QByteArray ffmpegOptions(const EncoderSettings &settings)
+{
+    QStringList options;
+    bool x26x = settings.format == "h264" || settings.format == "hevc";
+    if(x26x) {
+        options << QString("preset;%1").arg(settings.preset);
+    }
+    if(settings.bitrate > 0) {
+        options << QString("b;%1").arg(qint64(settings.bitrate)*1000);
+    }
+    else if(x26x) {
+        // quality 100 is lossless-ish CRF 0, 0 the worst CRF 51
+        int crf = qBound(0, 51 - settings.quality*51/100, 51);
+        options << QString("crf;%1").arg(crf);
+    }
+    return options.join("|").toLatin1();
+}
+
+}
+
+void EncoderSettings::save(QSettings &settings) const
+{
+    settings.beginGroup("encoder");
+    settings.setValue("format", format);
+    settings.setValue("bitrate", bitrate);
+    settings.setValue("quality", quality);
+    settings.setValue("preset", preset);
+    settings.endGroup();
+}
+
+EncoderSettings EncoderSettings::load(QSettings &settings)
+{
+    EncoderSettings s;
+    settings.beginGroup("encoder");
+    s.format = settings.value("format", s.format).toString();
+    s.bitrate = settings.value("bitrate", s.bitrate).toInt();
+    s.quality = settings.value("quality", s.quality).toInt();
+    s.preset = settings.value("preset", s.preset).toString();
+    settings.endGroup();
+    return s;
+}
+
+QStringList EncoderSettings::formats()
+{
+    return QStringList() << "mp4" << "h264" << "hevc" << "avi" << "ffv1";
+}
+
+QStringList EncoderSettings::presets()
+{
+    return QStringList() << "ultrafast" << "superfast" << "veryfast" << "faster" << "fast"
+                         << "medium" << "slow" << "slower" << "veryslow";
+}
+
+bool VideoEncoder::openWriter(cv::VideoWriter &writer, const QString &file_name,
+                              const EncoderSettings &settings, double fps, cv::Size size)
+{
+    int fourcc = fourccForFormat(settings.format);
+    if(fourcc == -1) {
+        qWarning() << "unknown video format" << settings.format;
+        return false;
+    }
+
+    bool opened = false;
+    if(settings.format == "avi" && settings.bitrate <= 0) {
+        // the FFmpeg writer, which OpenCV picks first for MJPG, ignores
+        // VIDEOWRITER_PROP_QUALITY; OpenCV's own MJPEG writer honors it
+        opened = writer.open(file_name.toStdString(), cv::CAP_OPENCV_MJPEG, fourcc, fps, size);
+        if(!opened) {
+            qWarning() << "OpenCV's MJPEG writer is unavailable, the quality setting is ignored";
+        }
+        else if(!writer.set(cv::VIDEOWRITER_PROP_QUALITY, settings.quality)) {
+            qWarning() << "unable to set MJPEG quality" << settings.quality;
+        }
+    }
+    if(!opened) {
+        // the variable is process wide; writers opened at the same time
+        // must not see each other's options
+        std::lock_guard<std::mutex> lock(writer_options_mutex);
+        QByteArray previous = qgetenv(writer_options_variable);
+        qputenv(writer_options_variable, ffmpegOptions(settings));
+        opened = writer.open(file_name.toStdString(), fourcc, fps, size);
+        if(previous.isEmpty()) {
+            qunsetenv(writer_options_variable);
+        }
+        else {
+            qputenv(writer_options_variable, previous);
+        }
+    }
+    return opened;
+}
+
+VideoEncoder::VideoEncoder()
+{
+}
+
+VideoEncoder::~VideoEncoder()
+{
+    close();
+}
+
+bool VideoEncoder::open(const QString &file_name, const EncoderSettings &settings,
+                        double fps, cv::Size size, int capacity)
+{
+    close();
+    if(!openWriter(m_writer, file_name, settings, fps, size)) {
+        return false;
+    }
+    m_frames.assign(std::max(capacity, 1), cv::Mat());
+    m_frame_indices.assign(m_frames.size(), -1);
+    m_next_write = 0;
+    m_next_encode = 0;
+    m_stop = false;
+    m_stats = Stats();
+    m_stats.capacity = static_cast<int>(m_frames.size());
+    m_encode_seconds = 0.0;
+    m_thread = std::thread(&VideoEncoder::encodeLoop, this);
+    return true;
+}
+
+void VideoEncoder::close()
+{
+    if(!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    m_thread.join();
+    m_writer.release();
+}
+
+cv::Mat* VideoEncoder::waitForSlot(std::unique_lock<std::mutex> &lock)
+{
+    long long capacity = static_cast<long long>(m_frames.size());
+    if(m_next_write - m_next_encode >= capacity) {
+        ++m_stats.stalls;
+        m_changed.wait(lock, [&]{ return m_stop || m_next_write - m_next_encode < capacity; });
+    }
+    if(m_stop) {
+        return nullptr;
+    }
+    return &m_frames[m_next_write % capacity];
+}
+
+void VideoEncoder::queued(std::unique_lock<std::mutex> &lock, int frame_index)
+{
+    m_frame_indices[m_next_write % m_frames.size()] = frame_index;
+    ++m_next_write;
+    lock.unlock();
+    m_changed.notify_all();
+}
+
+bool VideoEncoder::write(const cv::Mat &frame, int frame_index)
+{
+    if(!isOpened() || frame.empty()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    cv::Mat *slot = waitForSlot(lock);
+    if(!slot) {
+        return false;
+    }
+    // the encoder never touches a slot that is not queued
+    frame.copyTo(*slot);
+    queued(lock, frame_index);
+    return true;
+}
+
+bool VideoEncoder::push(cv::Mat &frame, int frame_index)
+{
+    if(!isOpened() || frame.empty()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    cv::Mat *slot = waitForSlot(lock);
+    if(!slot) {
+        return false;
+    }
+    cv::swap(*slot, frame);
+    queued(lock, frame_index);
+    return true;
+}
+
+VideoEncoder::Stats VideoEncoder::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.queued = static_cast<int>(m_next_write - m_next_encode);
+    stats.encode_fps = m_encode_seconds > 0.0 ? stats.encoded/m_encode_seconds : 0.0;
+    return stats;
+}
+
+void VideoEncoder::encodeLoop()
+{
+    while(true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [&]{ return m_stop || m_next_encode < m_next_write; });
+        // a close still encodes everything queued before it
+        if(m_next_encode >= m_next_write) {
+            return;
+        }
+        size_t slot = m_next_encode % m_frames.size();
+        int frame_index = m_frame_indices[slot];
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            StageTimings::Scope timing(StageTimings::Encode, frame_index);
+            m_writer.write(m_frames[slot]);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        ++m_next_encode;
+        ++m_stats.encoded;
+        m_encode_seconds += seconds;
+        lock.unlock();
+        m_changed.notify_all();
+    }
+}
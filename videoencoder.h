@@ -0,0 +1,94 @@
+#ifndef VIDEOENCODER_H
+#define VIDEOENCODER_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <QString>
+#include <QStringList>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class QSettings;
+
+// what to encode with; format names are the ones of videoformat.h
+struct EncoderSettings
+{
+    QString format = "mp4";
+    int bitrate = 0;            // kbit/s; 0 encodes by quality instead
+    int quality = 75;           // 0-100, CRF for h264/hevc, JPEG quality for avi
+    QString preset = "medium";  // x264/x265 speed preset
+
+    void save(QSettings &settings) const;
+    static EncoderSettings load(QSettings &settings);
+
+    static QStringList formats();
+    static QStringList presets();
+};
+
+// A cv::VideoWriter on its own thread behind a bounded queue of reused
+// frames, so a slow codec holds up neither the UI nor the compositing
+// workers until the queue is full. Frames are encoded in the order they
+// were queued.
+class VideoEncoder
+{
+public:
+    struct Stats
+    {
+        int queued = 0;
+        int capacity = 0;
+        long long encoded = 0;
+        long long stalls = 0;       // write waited for a free slot
+        double encode_fps = 0.0;    // frames per second of encoder time
+    };
+
+    VideoEncoder();
+    ~VideoEncoder();
+
+    // opens the writer here, so a failure is reported to the caller, and
+    // starts the encoder thread; an open encoder is closed first
+    bool open(const QString &file_name, const EncoderSettings &settings,
+              double fps, cv::Size size, int capacity = 8);
+    // encodes what is queued, then releases the writer
+    void close();
+    bool isOpened() const { return m_thread.joinable(); }
+
+    // queue a copy of frame; blocks while the queue is full
+    bool write(const cv::Mat &frame, int frame_index = -1);
+    // queue frame without copying; frame is left holding a spare buffer
+    bool push(cv::Mat &frame, int frame_index = -1);
+
+    Stats stats() const;
+
+    // open writer with the codec, rate control and preset of settings;
+    // for callers that encode on their own thread
+    static bool openWriter(cv::VideoWriter &writer, const QString &file_name,
+                           const EncoderSettings &settings, double fps, cv::Size size);
+
+private:
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+    // the slot for the next frame once there is room
+    cv::Mat* waitForSlot(std::unique_lock<std::mutex> &lock);
+    void queued(std::unique_lock<std::mutex> &lock, int frame_index);
+    void encodeLoop();
+
+    cv::VideoWriter m_writer;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<cv::Mat> m_frames;
+    std::vector<int> m_frame_indices;
+    long long m_next_write = 0;
+    long long m_next_encode = 0;
+    bool m_stop = false;
+
+    Stats m_stats;
+    double m_encode_seconds = 0.0;
+
+    std::thread m_thread;
+};
+
+#endif // VIDEOENCODER_H
@@ -0,0 +1,29 @@
+#ifndef VIDEOFORMAT_H
+#define VIDEOFORMAT_H
+
+#include <QString>
+#include <opencv2/videoio.hpp>
+
+// map an output format name to the fourcc passed to cv::VideoWriter
+static inline int fourccForFormat( const QString &format )
+{
+    if(format == "mp4") {
+        return cv::VideoWriter::fourcc('m','p','4','v');
+    }
+    if(format == "avi") {
+        return cv::VideoWriter::fourcc('M','J','P','G');
+    }
+    if(format == "h264"){
+        return cv::VideoWriter::fourcc('h','2','6','4');
+    }
+    if(format == "hevc") {
+        return cv::VideoWriter::fourcc('h','e','v','1');
+    }
+    // lossless, for archiving in .mkv or .avi
+    if(format == "ffv1") {
+        return cv::VideoWriter::fourcc('F','F','V','1');
+    }
+    return -1;
+}
+
+#endif // VIDEOFORMAT_H
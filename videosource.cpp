@@ -0,0 +1,143 @@
+#include "videosource.h"
+#include "stagetimings.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// without keyframes, farther jumps are left to the backend
+const int max_forward_grabs = 250;
+// frames decoded just before a seek target are cached for stepping back
+const int keep_before_target = 32;
+
+}
+
+VideoSource::VideoSource()
+{
+}
+
+bool VideoSource::open(const QString &file_name, bool index)
+{
+    close();
+    bool is_camera = false;
+    int camera = file_name.toInt(&is_camera);
+    m_device = is_camera || file_name.startsWith("/dev/");
+    bool opened = is_camera ? m_capture.open(camera) : m_capture.open(file_name.toStdString());
+    if(!opened) {
+        return false;
+    }
+    if(m_device) {
+        // frames are wanted as soon as they are captured, not queued
+        m_capture.set(cv::CAP_PROP_BUFFERSIZE, 1);
+    }
+    m_position = 0;
+    if(index && !m_device) {
+        m_index.open(file_name);
+    }
+    return true;
+}
+
+void VideoSource::close()
+{
+    m_index.close();
+    m_capture.release();
+    m_position = -1;
+    m_device = false;
+    m_cache.clear();
+}
+
+int VideoSource::frameCount() const
+{
+    int count = m_index.frameCount();
+    return count >= 0 ? count : static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_COUNT));
+}
+
+double VideoSource::timestamp(int index) const
+{
+    double time_ms = m_index.timestamp(index);
+    if(std::isnan(time_ms)) {
+        double fps = m_capture.get(cv::CAP_PROP_FPS);
+        time_ms = fps > 0.0 ? index*1000.0/fps : 0.0;
+    }
+    return time_ms;
+}
+
+bool VideoSource::read(int index, cv::Mat &frame, double *time_ms)
+{
+    if(index < 0) {
+        return false;
+    }
+    if(m_cache.find(index, frame)) {
+        if(time_ms) {
+            *time_ms = timestamp(index);
+        }
+        return true;
+    }
+
+    {
+        StageTimings::Scope timing(StageTimings::Decode, index);
+        // position on index, then grab index itself
+        if(!grabTo(index, true) || !m_capture.grab()) {
+            m_position = -1;
+            return false;
+        }
+        ++m_position;
+        if(!m_capture.retrieve(frame)) {
+            m_position = -1;
+            return false;
+        }
+    }
+    if(time_ms) {
+        // the decoder's PTS of the frame just grabbed
+        *time_ms = m_index.isReady() ? m_index.timestamp(index) : m_capture.get(cv::CAP_PROP_POS_MSEC);
+    }
+    m_cache.insert(index, frame);
+    return true;
+}
+
+bool VideoSource::seek(int index)
+{
+    return grabTo(index, false);
+}
+
+bool VideoSource::grabTo(int index, bool keep_frames)
+{
+    if(!m_capture.isOpened() || index < 0) {
+        return false;
+    }
+    if(index == m_position) {
+        return true;
+    }
+
+    // decode forward from where we are unless a keyframe lies in between
+    bool forward = m_position >= 0 && m_position <= index;
+    int keyframe = m_index.keyframeBefore(index);
+    if(keyframe < 0) {
+        if(!forward || index - m_position > max_forward_grabs) {
+            // no keyframes known: let the backend seek on its own
+            m_capture.set(cv::CAP_PROP_POS_FRAMES, index);
+            m_position = index;
+            return true;
+        }
+    }
+    else if(!forward || m_position < keyframe) {
+        m_capture.set(cv::CAP_PROP_POS_FRAMES, keyframe);
+        m_position = keyframe;
+    }
+
+    // frames close to the target are kept for stepping back
+    while(m_position < index) {
+        if(!m_capture.grab()) {
+            m_position = -1;
+            return false;
+        }
+        if(keep_frames && index - m_position <= keep_before_target && !m_cache.contains(m_position)
+                && m_capture.retrieve(m_retrieved)) {
+            m_cache.insert(m_position, m_retrieved);
+        }
+        ++m_position;
+    }
+    return true;
+}
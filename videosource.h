@@ -0,0 +1,62 @@
+#ifndef VIDEOSOURCE_H
+#define VIDEOSOURCE_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <QString>
+
+#include "framecache.h"
+#include "keyframeindex.h"
+
+// A video capture with accurate random access for scrubbing. Seeks go to
+// the last keyframe before the target and decode forward, so long-GOP
+// streams land on the right frame. Decoded frames go into a frame cache,
+// which serves loops and stepping back and forth from memory.
+//
+// Only one thread may read at a time: the UI while paused, the pipeline
+// decoder while playing.
+class VideoSource
+{
+public:
+    VideoSource();
+
+    // index starts building the keyframe index in the background. A
+    // camera number or /dev/video* path opens a live capture device,
+    // which is only ever read forward and never indexed.
+    bool open(const QString &file_name, bool index = true);
+    void close();
+    bool isOpened() const { return m_capture.isOpened(); }
+    bool isDevice() const { return m_device; }
+
+    double get(int property) const { return m_capture.get(property); }
+    bool set(int property, double value) { return m_capture.set(property, value); }
+    // exact once the keyframe index is ready, estimated before
+    int frameCount() const;
+
+    // decoded frame at index, copied into frame; time_ms receives its
+    // presentation time from the index or the decoder
+    bool read(int index, cv::Mat &frame, double *time_ms = nullptr);
+    // presentation time of a frame; estimated from the frame rate when
+    // neither the index nor the decoder knows it
+    double timestamp(int index) const;
+    // position the capture so its next grab returns frame index
+    bool seek(int index);
+
+    const KeyframeIndex& index() const { return m_index; }
+    FrameCache& cache() { return m_cache; }
+
+private:
+    // position the capture so its next grab returns frame index; frames
+    // decoded on the way may be kept in the cache
+    bool grabTo(int index, bool keep_frames);
+
+    cv::VideoCapture m_capture;
+    KeyframeIndex m_index;
+    FrameCache m_cache;
+    // frame index the next grab() returns, -1 if unknown
+    int m_position = -1;
+    bool m_device = false;
+    cv::Mat m_retrieved;
+};
+
+#endif // VIDEOSOURCE_H